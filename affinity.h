@@ -0,0 +1,69 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+// CPU亲和性相关的辅助函数
+// reactor线程和工作线程都按序号绑定到进程允许使用的CPU上：reactor占用开头的序号，
+// 各通道的线程池依次接在后面，CPU用完后才从头循环，慢的auth/db线程不会都挤在reactor 0的核上
+// 线程池据此把请求优先交给与reactor同核、其次同NUMA节点的工作线程
+
+// 进程允许使用的CPU列表(受cpuset/taskset限制)
+inline std::vector<int> allowed_cpus() {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int i = 0; i < CPU_SETSIZE; ++i) {
+            if (CPU_ISSET(i, &set)) {
+                cpus.push_back(i);
+            }
+        }
+    }
+    if (cpus.empty()) {
+        cpus.push_back(0);
+    }
+    return cpus;
+}
+
+// 第index个线程应当绑定的CPU
+inline int cpu_for(int index) {
+    static std::vector<int> cpus = allowed_cpus();
+    return cpus[index % cpus.size()];
+}
+
+// 把当前线程绑定到cpu，失败时不影响运行
+inline bool pin_thread(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+// cpu所在的NUMA节点，读取/sys/devices/system/cpu/cpuN/nodeM，无法确定时为0
+inline int cpu_node(int cpu) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR* dir = opendir(path);
+    if (!dir) {
+        return 0;
+    }
+    int node = 0;
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (strncmp(ent->d_name, "node", 4) == 0) {
+            node = atoi(ent->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+#endif
@@ -0,0 +1,79 @@
+#include "buffer_pool.h"
+#include <stdlib.h>
+
+buffer_pool::buffer_pool() : m_leased(0), m_cached(0) {
+    for (int i = 0; i < CLASS_NUM; ++i) {
+        m_free[i] = NULL;
+        m_free_bytes[i] = 0;
+    }
+}
+
+buffer_pool::~buffer_pool() {
+    for (int i = 0; i < CLASS_NUM; ++i) {
+        while (m_free[i]) {
+            free_block* b = m_free[i];
+            m_free[i] = b->next;
+            ::free(b);
+        }
+    }
+}
+
+buffer_pool* buffer_pool::GetInstance() {
+    static buffer_pool pool;
+    return &pool;
+}
+
+// 能放下size字节的最小一级
+int buffer_pool::size_class(int size) {
+    int c = 0;
+    while (c < CLASS_NUM && (MIN_BLOCK << c) < size) {
+        ++c;
+    }
+    return c;
+}
+
+char* buffer_pool::alloc(int size, int* cap) {
+    int c = size_class(size);
+    if (c == CLASS_NUM) {
+        return NULL;
+    }
+    int bytes = MIN_BLOCK << c;
+    free_block* b = NULL;
+    m_lock[c].lock();
+    if (m_free[c]) {
+        b = m_free[c];
+        m_free[c] = b->next;
+        m_free_bytes[c] -= bytes;
+        m_cached -= bytes;
+    }
+    m_lock[c].unlock();
+    if (!b) {
+        b = (free_block*)malloc(bytes);
+        if (!b) {
+            return NULL;
+        }
+    }
+    m_leased += bytes;
+    *cap = bytes;
+    return (char*)b;
+}
+
+void buffer_pool::free(char* block, int cap) {
+    int c = size_class(cap);
+    int bytes = MIN_BLOCK << c;
+    m_leased -= bytes;
+    m_lock[c].lock();
+    if (m_free_bytes[c] + bytes <= CACHE_PER_CLASS) {
+        free_block* b = (free_block*)block;
+        b->next = m_free[c];
+        m_free[c] = b;
+        m_free_bytes[c] += bytes;
+        m_cached += bytes;
+        block = NULL;
+    }
+    m_lock[c].unlock();
+    // 缓存已满，还给系统
+    if (block) {
+        ::free(block);
+    }
+}
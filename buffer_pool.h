@@ -0,0 +1,45 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <atomic>
+#include "locker.h"
+
+// 连接的读写缓冲区只内联一小段，放不下时从这里租用更大的块
+// 块按大小分级(4KB起每级翻倍，最大1MB)，每级一个空闲链表，归还的块留在链表中复用，
+// 每级缓存的字节数有上限，超过的直接释放
+class buffer_pool {
+   public:
+    static const int MIN_BLOCK = 4096;             // 最小一级的块大小
+    static const int CLASS_NUM = 9;                // 4KB ~ 1MB
+    static const int MAX_BLOCK = MIN_BLOCK << (CLASS_NUM - 1);
+    static const long CACHE_PER_CLASS = 4L << 20;  // 每级最多缓存4MB
+
+    // 单例模式(局部静态变量懒汉模式)
+    static buffer_pool* GetInstance();
+
+    // 租用一块至少size字节的块，实际大小写入cap；size超过MAX_BLOCK时返回NULL
+    char* alloc(int size, int* cap);
+    // 归还alloc得到的块，cap为alloc时得到的大小
+    void free(char* block, int cap);
+
+    long leased() const { return m_leased.load(std::memory_order_relaxed); }  // 租出的字节数
+    long cached() const { return m_cached.load(std::memory_order_relaxed); }  // 空闲链表中的字节数
+
+   private:
+    buffer_pool();
+    ~buffer_pool();
+    static int size_class(int size);
+
+    // 空闲的块本身存放链表指针
+    struct free_block {
+        free_block* next;
+    };
+
+    locker m_lock[CLASS_NUM];
+    free_block* m_free[CLASS_NUM];
+    long m_free_bytes[CLASS_NUM];
+    std::atomic<long> m_leased;
+    std::atomic<long> m_cached;
+};
+
+#endif
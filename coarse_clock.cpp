@@ -0,0 +1,65 @@
+#include "coarse_clock.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char day_names[] = "SunMonTueWedThuFriSat";
+static const char month_names[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+void coarse_clock::update() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    m_now_ms = ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    if (ts.tv_sec != m_date_sec) {
+        m_date_sec = ts.tv_sec;
+        memcpy(m_date_line, "Date: ", 6);
+        char* p = http_date(m_date_line + 6, ts.tv_sec);
+        memcpy(p, "\r\n", 2);
+    }
+}
+
+static char* put_2digits(char* p, int v) {
+    p[0] = '0' + v / 10;
+    p[1] = '0' + v % 10;
+    return p + 2;
+}
+
+char* http_date(char* p, time_t t) {
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    memcpy(p, day_names + tm.tm_wday * 3, 3);
+    memcpy(p + 3, ", ", 2);
+    p = put_2digits(p + 5, tm.tm_mday);
+    *p++ = ' ';
+    memcpy(p, month_names + tm.tm_mon * 3, 3);
+    p += 3;
+    *p++ = ' ';
+    p = put_2digits(p, (tm.tm_year + 1900) / 100);
+    p = put_2digits(p, (tm.tm_year + 1900) % 100);
+    *p++ = ' ';
+    p = put_2digits(p, tm.tm_hour);
+    *p++ = ':';
+    p = put_2digits(p, tm.tm_min);
+    *p++ = ':';
+    p = put_2digits(p, tm.tm_sec);
+    memcpy(p, " GMT", 4);
+    return p + 4;
+}
+
+bool parse_http_date(const char* text, time_t* t) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    char mon[4];
+    if (sscanf(text, "%*3s, %2d %3s %4d %2d:%2d:%2d GMT", &tm.tm_mday, mon, &tm.tm_year, &tm.tm_hour, &tm.tm_min,
+               &tm.tm_sec) != 6) {
+        return false;
+    }
+    const char* m = strstr(month_names, mon);
+    if (!m || strlen(mon) != 3 || (m - month_names) % 3 != 0) {
+        return false;
+    }
+    tm.tm_mon = (m - month_names) / 3;
+    tm.tm_year -= 1900;
+    *t = timegm(&tm);
+    return *t != -1;
+}
@@ -0,0 +1,30 @@
+#ifndef COARSE_CLOCK_H
+#define COARSE_CLOCK_H
+
+#include <time.h>
+
+// 每个线程各自的粗粒度时钟
+// reactor线程每批事件、工作线程每次处理请求前调用update()读一次CLOCK_*_COARSE(vDSO，不进入内核)，
+// 之后定时器的超时时间和应答的Date行都直接取缓存的值；Date行只在秒数变化时重新生成
+class coarse_clock {
+   public:
+    static const int DATE_LINE_LEN = 37;  // "Date: " + IMF-fixdate + "\r\n"
+
+    static void update();
+    // 上次update时的单调时钟(毫秒)
+    static time_t now_ms() { return m_now_ms; }
+    // 上次update时的"Date: ...\r\n"，不以\0结尾；随时会被本线程改写，使用时要复制
+    static const char* date_line() { return m_date_line; }
+
+   private:
+    static inline thread_local time_t m_now_ms = 0;
+    static inline thread_local time_t m_date_sec = -1;
+    static inline thread_local char m_date_line[DATE_LINE_LEN] = {};
+};
+
+// RFC 7231的IMF-fixdate，固定29个字符，ex. Sun, 06 Nov 1994 08:49:37 GMT
+char* http_date(char* p, time_t t);
+// 只接受IMF-fixdate，其他格式返回false
+bool parse_http_date(const char* text, time_t* t);
+
+#endif
@@ -0,0 +1,105 @@
+#include "compress.h"
+#include <brotli/encode.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <zlib.h>
+
+// ex. "gzip, deflate, br;q=1.0, *;q=0"
+int accepted_encodings(const char* value) {
+    int mask = 0;
+    const char* p = value;
+    while (*p) {
+        while (*p == ' ' || *p == '\t' || *p == ',') {
+            ++p;
+        }
+        const char* name = p;
+        while (*p && *p != ',' && *p != ';' && *p != ' ' && *p != '\t') {
+            ++p;
+        }
+        int name_len = p - name;
+        // 参数中只关心q，q=0、q=0.0、q=0.00...表示不接受
+        bool refused = false;
+        while (*p && *p != ',') {
+            if (*p == ';') {
+                ++p;
+                while (*p == ' ' || *p == '\t') {
+                    ++p;
+                }
+                if ((p[0] == 'q' || p[0] == 'Q') && p[1] == '=') {
+                    const char* q = p + 2;
+                    if (*q == '0') {
+                        ++q;
+                        if (*q == '.') {
+                            ++q;
+                        }
+                        while (*q == '0') {
+                            ++q;
+                        }
+                        refused = !(*q >= '1' && *q <= '9');
+                    }
+                }
+                continue;
+            }
+            ++p;
+        }
+        if (!refused) {
+            if (name_len == 4 && strncasecmp(name, "gzip", 4) == 0) {
+                mask |= ENC_GZIP;
+            } else if (name_len == 2 && strncasecmp(name, "br", 2) == 0) {
+                mask |= ENC_BR;
+            }
+        }
+    }
+    return mask;
+}
+
+bool compress_gzip(const char* src, size_t len, char** out, size_t* out_len) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    // windowBits加16输出gzip格式
+    if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    size_t cap = deflateBound(&zs, len);
+    char* buf = (char*)malloc(cap);
+    if (!buf) {
+        deflateEnd(&zs);
+        return false;
+    }
+    zs.next_in = (Bytef*)src;
+    zs.avail_in = len;
+    zs.next_out = (Bytef*)buf;
+    zs.avail_out = cap;
+    int ret = deflate(&zs, Z_FINISH);
+    size_t n = zs.total_out;
+    deflateEnd(&zs);
+    if (ret != Z_STREAM_END) {
+        free(buf);
+        return false;
+    }
+    *out = buf;
+    *out_len = n;
+    return true;
+}
+
+bool compress_brotli(const char* src, size_t len, char** out, size_t* out_len) {
+    size_t cap = BrotliEncoderMaxCompressedSize(len);
+    if (cap == 0) {
+        return false;
+    }
+    char* buf = (char*)malloc(cap);
+    if (!buf) {
+        return false;
+    }
+    size_t n = cap;
+    // 最高质量(11)压缩1MB的文本要一秒左右，会长时间占住工作线程，用9
+    if (!BrotliEncoderCompress(9, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, len, (const uint8_t*)src, &n,
+                               (uint8_t*)buf)) {
+        free(buf);
+        return false;
+    }
+    *out = buf;
+    *out_len = n;
+    return true;
+}
@@ -0,0 +1,17 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stddef.h>
+
+// 内容编码，按Accept-Encoding协商
+enum CONTENT_ENCODING { ENC_IDENTITY = 0, ENC_GZIP = 1, ENC_BR = 2 };
+
+// 解析Accept-Encoding的值，返回接受的编码(ENC_GZIP | ENC_BR)，q=0的编码不算
+int accepted_encodings(const char* value);
+
+// 压缩整段内容，成功时*out为malloc申请的结果；只在生成缓存的变体时调用一次，压缩率优先
+// 需要链接-lz和-lbrotlienc
+bool compress_gzip(const char* src, size_t len, char** out, size_t* out_len);
+bool compress_brotli(const char* src, size_t len, char** out, size_t* out_len);
+
+#endif
@@ -0,0 +1,194 @@
+#include "config.h"
+#include <string.h>
+
+config::config() {
+    port = 0;
+    io_backend = IO_EPOLL;
+    io_model = MODEL_PROACTOR;
+    tick_ms = 1000;
+    // 默认每个CPU核心一个reactor
+    reactor_num = sysconf(_SC_NPROCESSORS_ONLN);
+    if (reactor_num <= 0) {
+        reactor_num = 1;
+    }
+    // 静态文件处理很快，队列满时由reactor直接处理；登录和注册队列满时直接拒绝
+    lanes[LANE_STATIC].threads = 8;
+    lanes[LANE_STATIC].max_requests = 10000;
+    lanes[LANE_STATIC].policy = OVERLOAD_INLINE;
+    lanes[LANE_AUTH].threads = 2;
+    lanes[LANE_AUTH].max_requests = 1000;
+    lanes[LANE_AUTH].policy = OVERLOAD_REJECT;
+    // 注册线程数不超过数据库连接池的连接数的一半
+    lanes[LANE_DB].threads = 4;
+    lanes[LANE_DB].max_requests = 256;
+    lanes[LANE_DB].policy = OVERLOAD_REJECT;
+
+    max_conn = 0;
+    max_wait_ms = 1000;
+    retry_after = 1;
+    max_request_kb = 64;
+    file_send = FILE_SENDFILE;
+    cache_mb = 64;
+    preload = false;
+    zip_cache_mb = 16;
+    write_budget_kb = 256;
+    cache_rule_count = 0;
+}
+
+const char* config::lane_name(int lane) {
+    static const char* names[LANE_NUM] = {"static", "auth", "db"};
+    return names[lane];
+}
+
+void config::usage(const char* prog) {
+    printf("usage: %s [-r reactor_num] [-b epoll|uring] [-a proactor|reactor] [-t tick_ms]\n"
+           "          [-L static|auth|db:threads:max_requests[:reject|inline]]...\n"
+           "          [-c max_conn] [-w max_wait_ms] [-R retry_after] [-m max_request_kb]\n"
+           "          [-s sendfile|mmap] [-C cache_mb] [-p] [-E prefix:max_age]...\n"
+           "          [-z zip_cache_mb] [-W write_budget_kb] port_number\n", prog);
+}
+
+bool config::parse_lane(const char* arg) {
+    char name[16], policy[16] = "";
+    int threads, max_requests;
+    // ex. db:4:256:reject
+    int n = sscanf(arg, "%15[^:]:%d:%d:%15s", name, &threads, &max_requests, policy);
+    if (n < 3 || threads <= 0 || max_requests <= 0) {
+        return false;
+    }
+    int lane = 0;
+    while (lane < LANE_NUM && strcmp(name, lane_name(lane)) != 0) {
+        ++lane;
+    }
+    if (lane == LANE_NUM) {
+        return false;
+    }
+    lanes[lane].threads = threads;
+    lanes[lane].max_requests = max_requests;
+    if (n == 4) {
+        if (strcmp(policy, "reject") == 0) {
+            lanes[lane].policy = OVERLOAD_REJECT;
+        } else if (strcmp(policy, "inline") == 0) {
+            lanes[lane].policy = OVERLOAD_INLINE;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool config::parse_cache_rule(const char* arg) {
+    if (cache_rule_count == MAX_CACHE_RULES) {
+        return false;
+    }
+    cache_rule* rule = &cache_rules[cache_rule_count];
+    // ex. /static/:86400
+    if (sscanf(arg, "%63[^:]:%d", rule->prefix, &rule->max_age) != 2 || rule->prefix[0] != '/' || rule->max_age < 0) {
+        return false;
+    }
+    ++cache_rule_count;
+    return true;
+}
+
+bool config::parse_arg(int argc, char* argv[]) {
+    int opt;
+    const char* str = "r:b:a:t:L:c:w:R:m:s:C:pE:z:W:";
+    while ((opt = getopt(argc, argv, str)) != -1) {
+        switch (opt) {
+            case 'r': {
+                reactor_num = atoi(optarg);
+                break;
+            }
+            case 'b': {
+                if (strcmp(optarg, "epoll") == 0) {
+                    io_backend = IO_EPOLL;
+                } else if (strcmp(optarg, "uring") == 0) {
+                    io_backend = IO_URING;
+                } else {
+                    return false;
+                }
+                break;
+            }
+            case 'a': {
+                if (strcmp(optarg, "proactor") == 0) {
+                    io_model = MODEL_PROACTOR;
+                } else if (strcmp(optarg, "reactor") == 0) {
+                    io_model = MODEL_REACTOR;
+                } else {
+                    return false;
+                }
+                break;
+            }
+            case 't': {
+                tick_ms = atoi(optarg);
+                break;
+            }
+            case 'L': {
+                if (!parse_lane(optarg)) {
+                    return false;
+                }
+                break;
+            }
+            case 'c': {
+                max_conn = atoi(optarg);
+                break;
+            }
+            case 'w': {
+                max_wait_ms = atoi(optarg);
+                break;
+            }
+            case 'R': {
+                retry_after = atoi(optarg);
+                break;
+            }
+            case 'm': {
+                max_request_kb = atoi(optarg);
+                break;
+            }
+            case 's': {
+                if (strcmp(optarg, "sendfile") == 0) {
+                    file_send = FILE_SENDFILE;
+                } else if (strcmp(optarg, "mmap") == 0) {
+                    file_send = FILE_MMAP;
+                } else {
+                    return false;
+                }
+                break;
+            }
+            case 'C': {
+                cache_mb = atoi(optarg);
+                break;
+            }
+            case 'p': {
+                preload = true;
+                break;
+            }
+            case 'z': {
+                zip_cache_mb = atoi(optarg);
+                break;
+            }
+            case 'W': {
+                write_budget_kb = atoi(optarg);
+                break;
+            }
+            case 'E': {
+                if (!parse_cache_rule(optarg)) {
+                    return false;
+                }
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+    // 剩下的第一个非选项参数为端口号
+    if (optind >= argc) {
+        return false;
+    }
+    port = atoi(argv[optind]);
+    if (port <= 0 || reactor_num <= 0 || tick_ms <= 0 || max_conn < 0 || max_wait_ms < 0 || retry_after < 0 ||
+        max_request_kb <= 0 || cache_mb < 0 || zip_cache_mb < 0 || write_budget_kb < 0) {
+        return false;
+    }
+    return true;
+}
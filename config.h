@@ -0,0 +1,86 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// I/O后端：epoll + recv/writev，或io_uring
+enum IO_BACKEND { IO_EPOLL = 0, IO_URING };
+
+// 事件处理模式(epoll后端)
+// MODEL_PROACTOR：reactor线程读写socket，工作线程只解析请求、生成应答(模拟Proactor)
+// MODEL_REACTOR：reactor线程只派发就绪事件，工作线程自己read、处理、write，socket由EPOLLONESHOT保证同时只有一个线程操作
+enum IO_MODEL { MODEL_PROACTOR = 0, MODEL_REACTOR };
+
+// 请求按类型分到不同的线程池(通道)，慢的数据库写入不会阻塞静态文件
+// LANE_STATIC：静态文件；LANE_AUTH：登录校验；LANE_DB：注册，需要写数据库
+enum LANE { LANE_STATIC = 0, LANE_AUTH, LANE_DB, LANE_NUM };
+
+// 通道的请求队列已满时的处理方式
+// OVERLOAD_REJECT：回复503后关闭连接；OVERLOAD_INLINE：由reactor线程直接处理
+enum OVERLOAD_POLICY { OVERLOAD_REJECT = 0, OVERLOAD_INLINE };
+
+// 静态文件的发送方式
+// FILE_SENDFILE：头部用MSG_MORE发送，文件用sendfile从页缓存直接发送，不映射
+// FILE_MMAP：每个请求mmap文件，与头部一起writev，发送完毕后munmap
+enum FILE_SEND_MODE { FILE_SENDFILE = 0, FILE_MMAP };
+
+// 一个通道的配置
+struct lane_config {
+    int threads;      // 工作线程数
+    int max_requests; // 请求队列上限
+    int policy;       // OVERLOAD_POLICY
+};
+
+// 按URL路径前缀设置静态文件应答的Cache-Control，最长的前缀优先
+struct cache_rule {
+    char prefix[64];  // ex. /static/
+    int max_age;      // 秒，0为no-cache(每次都要用ETag或Last-Modified验证)
+};
+
+// 服务器运行参数，由命令行解析得到
+class config {
+   public:
+    static const int MAX_CACHE_RULES = 16;
+
+    config();
+    ~config() {}
+
+    // 解析命令行，格式错误返回false
+    bool parse_arg(int argc, char* argv[]);
+    // 打印用法
+    static void usage(const char* prog);
+    static const char* lane_name(int lane);
+
+   public:
+    int port;         // 监听端口
+    int reactor_num;  // reactor线程数，每个线程独占一个epoll和一个SO_REUSEPORT监听socket
+    int io_backend;   // I/O后端，IO_EPOLL或IO_URING
+    int io_model;     // 事件处理模式，IO_MODEL；io_uring后端总是MODEL_PROACTOR
+    int tick_ms;      // 定时器tick的间隔(毫秒)，也是时间轮的槽宽
+    lane_config lanes[LANE_NUM];
+
+    // 过载保护：超过任一阈值时以503拒绝请求，并暂停accept，新连接留在监听队列中
+    int max_conn;     // 最大连接数，0表示只受MAX_FD限制
+    int max_wait_ms;  // 请求在通道队列中的最长排队时间，0表示不限制
+    int retry_after;  // 503应答中Retry-After的秒数
+
+    int max_request_kb;  // 一个请求最多占用的读缓冲区(KB)，超过时关闭连接
+    int file_send;       // 静态文件的发送方式，FILE_SEND_MODE
+    int cache_mb;        // 静态文件缓存的容量(MB)，0为不缓存
+    bool preload;        // 启动时把资源目录下的文件全部读入缓存
+    int zip_cache_mb;    // 压缩变体缓存的容量(MB)，0为不压缩
+    int write_budget_kb;  // 一个连接每轮最多发送的数据(KB)，0为不限制
+    cache_rule cache_rules[MAX_CACHE_RULES];  // 没有匹配的路径不发送Cache-Control
+    int cache_rule_count;
+
+   private:
+    // 解析"-L name:threads:max_requests[:reject|inline]"
+    bool parse_lane(const char* arg);
+    // 解析"-E prefix:max_age"
+    bool parse_cache_rule(const char* arg);
+};
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef CONN_SLAB_H
+#define CONN_SLAB_H
+
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+#include <vector>
+
+// 连接对象的slab分配器
+// 内存按块(每块SLAB_OBJECTS个对象)按需申请，块内每个对象按缓存行对齐，第一次分配到时才构造，
+// 没用到的部分不占物理内存；关闭的连接放回空闲栈，新连接优先复用最近释放的对象(仍在缓存中)，
+// 块在分配器销毁前不归还
+// 每个reactor一个，只由该reactor线程分配和释放，不加锁；计数可由其他线程读取
+template <typename T>
+class conn_slab {
+   public:
+    static const int SLAB_OBJECTS = 256;
+    static const size_t ALIGN = 64;
+
+    conn_slab()
+        : m_stride((sizeof(T) + ALIGN - 1) / ALIGN * ALIGN), m_fresh(SLAB_OBJECTS), m_capacity(0), m_in_use(0) {}
+    ~conn_slab();
+
+    // 取一个已构造的对象，对象的状态由使用者在init中重置
+    T* alloc();
+    void free(T* obj);
+
+    size_t capacity() const { return m_capacity.load(std::memory_order_relaxed); }  // 已申请的对象个数
+    size_t in_use() const { return m_in_use.load(std::memory_order_relaxed); }
+
+   private:
+    size_t m_stride;             // 相邻对象的间距，sizeof(T)向上取整到缓存行
+    std::vector<char*> m_chunks;  // 已申请的块
+    int m_fresh;                  // 最后一块中已构造的对象数
+    std::vector<T*> m_free;       // 已构造的空闲对象
+    std::atomic<size_t> m_capacity;
+    std::atomic<size_t> m_in_use;
+};
+
+template <typename T>
+conn_slab<T>::~conn_slab() {
+    for (size_t c = 0; c < m_chunks.size(); ++c) {
+        int constructed = c + 1 == m_chunks.size() ? m_fresh : SLAB_OBJECTS;
+        for (int i = 0; i < constructed; ++i) {
+            ((T*)(m_chunks[c] + i * m_stride))->~T();
+        }
+        ::free(m_chunks[c]);
+    }
+}
+
+// 先复用空闲对象，没有时在最后一块中构造下一个，最后一块用完时再申请一块
+template <typename T>
+T* conn_slab<T>::alloc() {
+    T* obj;
+    if (!m_free.empty()) {
+        obj = m_free.back();
+        m_free.pop_back();
+    } else {
+        if (m_fresh == SLAB_OBJECTS) {
+            char* chunk = (char*)aligned_alloc(ALIGN, m_stride * SLAB_OBJECTS);
+            if (!chunk) {
+                return NULL;
+            }
+            m_chunks.push_back(chunk);
+            m_fresh = 0;
+            m_capacity.store(m_capacity.load(std::memory_order_relaxed) + SLAB_OBJECTS, std::memory_order_relaxed);
+        }
+        obj = new (m_chunks.back() + m_fresh * m_stride) T();
+        ++m_fresh;
+    }
+    m_in_use.store(m_in_use.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return obj;
+}
+
+template <typename T>
+void conn_slab<T>::free(T* obj) {
+    m_free.push_back(obj);
+    m_in_use.store(m_in_use.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+}
+
+#endif
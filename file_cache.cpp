@@ -0,0 +1,313 @@
+#include "file_cache.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+file_cache::file_cache()
+    : m_shard_capacity(0),
+      m_header_fn(NULL),
+      m_hits(0),
+      m_misses(0),
+      m_evictions(0),
+      m_invalidations(0),
+      m_bytes(0),
+      m_files(0) {
+    for (int i = 0; i < SHARD_NUM; ++i) {
+        m_shards[i].head = NULL;
+        m_shards[i].tail = NULL;
+        m_shards[i].bytes = 0;
+        m_shards[i].gen = 0;
+    }
+}
+
+file_cache::~file_cache() {
+    for (int i = 0; i < SHARD_NUM; ++i) {
+        cached_file* f = m_shards[i].head;
+        while (f) {
+            cached_file* next = f->next;
+            release(f);
+            f = next;
+        }
+    }
+}
+
+file_cache* file_cache::GetInstance() {
+    static file_cache cache;
+    return &cache;
+}
+
+file_cache* file_cache::GetVariants() {
+    static file_cache variants;
+    return &variants;
+}
+
+void file_cache::init(size_t capacity) {
+    m_shard_capacity = capacity / SHARD_NUM;
+}
+
+file_cache::shard* file_cache::shard_of(const char* path) {
+    size_t h = std::hash<std::string_view>()(std::string_view(path));
+    return &m_shards[h % SHARD_NUM];
+}
+
+void file_cache::lru_unlink(shard* s, cached_file* f) {
+    if (f->prev) {
+        f->prev->next = f->next;
+    } else {
+        s->head = f->next;
+    }
+    if (f->next) {
+        f->next->prev = f->prev;
+    } else {
+        s->tail = f->prev;
+    }
+    f->prev = f->next = NULL;
+}
+
+void file_cache::lru_push_front(shard* s, cached_file* f) {
+    f->prev = NULL;
+    f->next = s->head;
+    if (s->head) {
+        s->head->prev = f;
+    } else {
+        s->tail = f;
+    }
+    s->head = f;
+}
+
+cached_file* file_cache::lookup(const char* path) {
+    shard* s = shard_of(path);
+    cached_file* f = NULL;
+    s->lock.lock();
+    auto it = s->map.find(std::string_view(path));
+    if (it != s->map.end()) {
+        f = it->second;
+        f->refs.fetch_add(1, std::memory_order_relaxed);
+        // 移到LRU头部
+        if (s->head != f) {
+            lru_unlink(s, f);
+            lru_push_front(s, f);
+        }
+    }
+    s->lock.unlock();
+    if (f) {
+        m_hits.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        m_misses.fetch_add(1, std::memory_order_relaxed);
+    }
+    return f;
+}
+
+// 移出的条目交出缓存持有的引用，还在发送的由最后一个连接释放
+void file_cache::drop(shard* s, cached_file* f) {
+    lru_unlink(s, f);
+    s->map.erase(std::string_view(f->path));
+    s->bytes -= f->size;
+    m_bytes -= f->size;
+    m_files--;
+    release(f);
+}
+
+void file_cache::evict(shard* s, size_t need) {
+    while (s->tail && s->bytes + need > m_shard_capacity) {
+        drop(s, s->tail);
+        m_evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+bool file_cache::invalidate(const char* path) {
+    shard* s = shard_of(path);
+    s->lock.lock();
+    ++s->gen;
+    auto it = s->map.find(std::string_view(path));
+    bool found = it != s->map.end();
+    if (found) {
+        drop(s, it->second);
+        m_invalidations.fetch_add(1, std::memory_order_relaxed);
+    }
+    s->lock.unlock();
+    return found;
+}
+
+int file_cache::invalidate_dir(const char* dir) {
+    std::string prefix(dir);
+    prefix += '/';
+    int dropped = 0;
+    for (int i = 0; i < SHARD_NUM; ++i) {
+        shard* s = &m_shards[i];
+        s->lock.lock();
+        ++s->gen;
+        cached_file* f = s->head;
+        while (f) {
+            cached_file* next = f->next;
+            if (f->path.compare(0, prefix.size(), prefix) == 0) {
+                drop(s, f);
+                ++dropped;
+            }
+            f = next;
+        }
+        s->lock.unlock();
+    }
+    m_invalidations.fetch_add(dropped, std::memory_order_relaxed);
+    return dropped;
+}
+
+void file_cache::clear() {
+    for (int i = 0; i < SHARD_NUM; ++i) {
+        shard* s = &m_shards[i];
+        s->lock.lock();
+        ++s->gen;
+        while (s->head) {
+            drop(s, s->head);
+            m_invalidations.fetch_add(1, std::memory_order_relaxed);
+        }
+        s->lock.unlock();
+    }
+}
+
+bool file_cache::canonical(const char* path) {
+    return !strstr(path, "//") && !strstr(path, "/./") && !strstr(path, "/../");
+}
+
+unsigned long file_cache::generation(const char* key) {
+    shard* s = shard_of(key);
+    s->lock.lock();
+    unsigned long gen = s->gen;
+    s->lock.unlock();
+    return gen;
+}
+
+cached_file* file_cache::load(const char* path) {
+    if (!canonical(path)) {
+        return NULL;
+    }
+    unsigned long gen = generation(path);
+
+    // 在锁外读文件，读取期间不阻塞同一分片的其他请求
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || !(st.st_mode & S_IROTH) || !cacheable(st.st_size)) {
+        close(fd);
+        return NULL;
+    }
+    char* data = (char*)malloc(st.st_size);
+    if (!data) {
+        close(fd);
+        return NULL;
+    }
+    size_t got = 0;
+    while (got < (size_t)st.st_size) {
+        ssize_t n = ::read(fd, data + got, st.st_size - got);
+        if (n <= 0) {
+            break;
+        }
+        got += n;
+    }
+    close(fd);
+    if (got != (size_t)st.st_size) {
+        free(data);
+        return NULL;
+    }
+    return insert(path, data, got, st, gen);
+}
+
+cached_file* file_cache::insert(const char* key, char* data, size_t size, const struct stat& st, unsigned long gen) {
+    cached_file* f = new cached_file;
+    f->path = key;
+    f->data = data;
+    f->size = size;
+    f->st = st;
+    if (m_header_fn) {
+        char header[HEADER_MAX];
+        f->header.assign(header, m_header_fn(header, sizeof(header), key, st, false));
+        f->not_modified.assign(header, m_header_fn(header, sizeof(header), key, st, true));
+    }
+    // 缓存一个引用，调用者一个引用
+    f->refs.store(2, std::memory_order_relaxed);
+    f->prev = f->next = NULL;
+
+    shard* s = shard_of(key);
+    s->lock.lock();
+    if (s->gen != gen || size > m_shard_capacity) {
+        // 读取期间有文件变化，读到的可能是旧内容或写了一半的内容，不放进缓存
+        s->lock.unlock();
+        f->refs.store(1, std::memory_order_relaxed);
+        return f;
+    }
+    auto it = s->map.find(std::string_view(f->path));
+    if (it != s->map.end()) {
+        // 其他线程已经读入
+        cached_file* old = it->second;
+        old->refs.fetch_add(1, std::memory_order_relaxed);
+        s->lock.unlock();
+        f->refs.store(1, std::memory_order_relaxed);
+        release(f);
+        return old;
+    }
+    evict(s, f->size);
+    s->map.emplace(std::string_view(f->path), f);
+    lru_push_front(s, f);
+    s->bytes += f->size;
+    s->lock.unlock();
+    m_bytes += f->size;
+    m_files++;
+    return f;
+}
+
+void file_cache::release(cached_file* f) {
+    if (f->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        free(f->data);
+        delete f;
+    }
+}
+
+int file_cache::preload_dir(const std::string& dir, bool* full) {
+    DIR* d = opendir(dir.c_str());
+    if (!d) {
+        return 0;
+    }
+    int loaded = 0;
+    struct dirent* e;
+    while (!*full && (e = readdir(d)) != NULL) {
+        if (e->d_name[0] == '.') {
+            continue;
+        }
+        std::string path = dir + "/" + e->d_name;
+        struct stat st;
+        if (stat(path.c_str(), &st) < 0) {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            loaded += preload_dir(path, full);
+            continue;
+        }
+        // 与do_request相同，只缓存其他用户可读的普通文件
+        if (!S_ISREG(st.st_mode) || !(st.st_mode & S_IROTH) || !cacheable(st.st_size)) {
+            continue;
+        }
+        if (m_bytes.load(std::memory_order_relaxed) + st.st_size > m_shard_capacity * SHARD_NUM) {
+            *full = true;
+            break;
+        }
+        cached_file* f = load(path.c_str());
+        if (f) {
+            release(f);
+            ++loaded;
+        }
+    }
+    closedir(d);
+    return loaded;
+}
+
+int file_cache::preload(const char* dir) {
+    if (!enabled()) {
+        return 0;
+    }
+    bool full = false;
+    return preload_dir(dir, &full);
+}
@@ -0,0 +1,111 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <sys/stat.h>
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "locker.h"
+
+// 缓存的文件：完整内容和读入时的stat结果
+// 引用计数包括缓存本身持有的一个，被淘汰或失效后等最后一个正在发送它的连接释放时才释放内存
+struct cached_file {
+    std::string path;
+    char* data;
+    size_t size;
+    struct stat st;
+    std::string header;        // 预先生成的200应答头部(状态行和实体头部，不含Connection行)
+    std::string not_modified;  // 预先生成的304应答头部
+    std::atomic<int> refs;
+    cached_file* prev;  // 分片内的LRU链表，头部最近使用
+    cached_file* next;
+};
+
+// 静态文件缓存
+// 以完整路径为键，所有工作线程共享；按路径哈希分成SHARD_NUM个分片，每个分片一把锁、一条LRU链表和
+// 容量的1/SHARD_NUM，超过时从该分片的LRU尾部淘汰，单个文件不超过分片容量才缓存。
+// 命中时不访问文件系统，内容的新旧由file_watcher监听文件变化后调用invalidate保证
+class file_cache {
+   public:
+    static const int SHARD_NUM = 16;
+    static const int HEADER_MAX = 512;  // 应答头部的最大长度
+
+    // 生成条目的200或304应答头部，返回长度；读入文件时在锁外调用
+    typedef int (*header_builder)(char* buf, int size, const char* path, const struct stat& st, bool not_modified);
+
+    // 单例模式(局部静态变量懒汉模式)
+    static file_cache* GetInstance();
+    // 压缩后的变体单独一个实例，以原文件路径加.gz/.br为键，有自己的容量
+    static file_cache* GetVariants();
+    // 路径中没有//、/./和/../，只有这样的路径才能缓存
+    static bool canonical(const char* path);
+
+    // 设置容量(字节)，0表示不缓存，启动时调用一次
+    void init(size_t capacity);
+    void set_header_builder(header_builder fn) { m_header_fn = fn; }
+    bool enabled() const { return m_shard_capacity > 0; }
+    // 能否缓存该大小的文件
+    bool cacheable(off_t size) const { return size > 0 && (size_t)size <= m_shard_capacity; }
+
+    // 命中时返回加了引用的条目，未命中返回NULL
+    cached_file* lookup(const char* path);
+    // 读入文件加入缓存，返回加了引用的条目；已被其他线程加入时返回已有的条目，读取失败返回NULL
+    // 读取期间该分片有条目失效时，返回的条目不加入缓存，只供这一次发送
+    cached_file* load(const char* path);
+    // 把内存中生成的内容(malloc申请，由缓存接管)以key加入缓存，返回加了引用的条目
+    // gen为开始生成前generation(key)的值，期间key所在分片有条目失效时不加入缓存，只供这一次发送
+    cached_file* insert(const char* key, char* data, size_t size, const struct stat& st, unsigned long gen);
+    unsigned long generation(const char* key);
+    // 移出path的条目，返回是否在缓存中
+    bool invalidate(const char* path);
+    // 移出目录dir下的全部条目，返回移出的个数
+    int invalidate_dir(const char* dir);
+    // 移出全部条目
+    void clear();
+    // 释放lookup/load得到的引用
+    static void release(cached_file* f);
+    // 递归读入目录下的全部普通文件，返回读入的文件数，缓存满后停止
+    int preload(const char* dir);
+
+    unsigned long hits() const { return m_hits.load(std::memory_order_relaxed); }
+    unsigned long misses() const { return m_misses.load(std::memory_order_relaxed); }
+    unsigned long evictions() const { return m_evictions.load(std::memory_order_relaxed); }
+    unsigned long invalidations() const { return m_invalidations.load(std::memory_order_relaxed); }
+    size_t bytes() const { return m_bytes.load(std::memory_order_relaxed); }
+    size_t files() const { return m_files.load(std::memory_order_relaxed); }
+
+   private:
+    file_cache();
+    ~file_cache();
+
+    struct shard {
+        locker lock;
+        std::unordered_map<std::string_view, cached_file*> map;  // 键指向条目自己的path，查找时不复制路径
+        cached_file* head;
+        cached_file* tail;
+        size_t bytes;
+        unsigned long gen;  // 每次有条目失效时加一，load据此丢弃读取期间可能已过时的内容
+    };
+
+    shard* shard_of(const char* path);
+    void lru_unlink(shard* s, cached_file* f);
+    void lru_push_front(shard* s, cached_file* f);
+    // 在分片锁内调用，把条目移出分片并交出缓存持有的引用
+    void drop(shard* s, cached_file* f);
+    // 在分片锁内调用，淘汰LRU尾部直到能放下need字节
+    void evict(shard* s, size_t need);
+    int preload_dir(const std::string& dir, bool* full);
+
+    size_t m_shard_capacity;
+    header_builder m_header_fn;
+    shard m_shards[SHARD_NUM];
+    std::atomic<unsigned long> m_hits;
+    std::atomic<unsigned long> m_misses;
+    std::atomic<unsigned long> m_evictions;
+    std::atomic<unsigned long> m_invalidations;
+    std::atomic<size_t> m_bytes;
+    std::atomic<size_t> m_files;
+};
+
+#endif
@@ -0,0 +1,171 @@
+#include "file_watcher.h"
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// 文件内容变化、写完、移入移出、删除，以及被监听的目录自身被删除或移走
+static const unsigned int WATCH_MASK = IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE |
+                                       IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+file_watcher* file_watcher::GetInstance() {
+    static file_watcher watcher;
+    return &watcher;
+}
+
+int file_watcher::start(const char* root, file_cache* cache, file_cache* variants) {
+    m_fd = inotify_init1(IN_CLOEXEC);
+    if (m_fd < 0) {
+        return -1;
+    }
+    m_cache = cache;
+    m_variants = variants;
+    int dirs = watch_dir(root);
+    if (dirs == 0) {
+        close(m_fd);
+        m_fd = -1;
+        return -1;
+    }
+    if (pthread_create(&m_thread, NULL, worker, this) != 0) {
+        close(m_fd);
+        m_fd = -1;
+        return -1;
+    }
+    pthread_detach(m_thread);
+    return dirs;
+}
+
+void* file_watcher::worker(void* arg) {
+    ((file_watcher*)arg)->run();
+    return NULL;
+}
+
+int file_watcher::watch_dir(const std::string& dir) {
+    int wd = inotify_add_watch(m_fd, dir.c_str(), WATCH_MASK);
+    if (wd < 0) {
+        // 多半是超过了fs.inotify.max_user_watches，该目录下的文件变化后需要重启才能生效
+        printf("inotify watch %s failure, errno is: %d\n", dir.c_str(), errno);
+        return 0;
+    }
+    m_dirs[wd] = dir;
+    int added = 1;
+    DIR* d = opendir(dir.c_str());
+    if (!d) {
+        return added;
+    }
+    struct dirent* e;
+    while ((e = readdir(d)) != NULL) {
+        if (e->d_name[0] == '.') {
+            continue;
+        }
+        std::string path = dir + "/" + e->d_name;
+        struct stat st;
+        if (lstat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+            added += watch_dir(path);
+        }
+    }
+    closedir(d);
+    return added;
+}
+
+void file_watcher::unwatch_dir(const std::string& dir) {
+    std::string prefix = dir + "/";
+    for (auto it = m_dirs.begin(); it != m_dirs.end();) {
+        if (it->second == dir || it->second.compare(0, prefix.size(), prefix) == 0) {
+            inotify_rm_watch(m_fd, it->first);
+            it = m_dirs.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void file_watcher::invalidate_variants(const std::string& path) {
+    m_variants->invalidate(path.c_str());
+    m_variants->invalidate((path + ".gz").c_str());
+    m_variants->invalidate((path + ".br").c_str());
+}
+
+void file_watcher::handle(int wd, unsigned int mask, const char* name) {
+    auto it = m_dirs.find(wd);
+    if (it == m_dirs.end()) {
+        return;
+    }
+    // 被监听的目录被删除(已经收到了其中每个文件的IN_DELETE)，监听随之失效
+    if (mask & IN_IGNORED) {
+        m_dirs.erase(it);
+        return;
+    }
+    if (!name || !*name) {
+        return;
+    }
+    std::string path = it->second + "/" + name;
+
+    if (mask & IN_ISDIR) {
+        if (mask & (IN_DELETE | IN_MOVED_FROM)) {
+            m_cache->invalidate_dir(path.c_str());
+            m_variants->invalidate_dir(path.c_str());
+            unwatch_dir(path);
+        } else if (mask & (IN_CREATE | IN_MOVED_TO)) {
+            // 移入的目录可能替换了同名的旧目录
+            m_cache->invalidate_dir(path.c_str());
+            m_variants->invalidate_dir(path.c_str());
+            watch_dir(path);
+        }
+        return;
+    }
+
+    if (mask & (IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM)) {
+        invalidate_variants(path);
+    }
+    if (mask & IN_MODIFY) {
+        // 正在写入，先失效，写完后再读入
+        if (m_cache->invalidate(path.c_str())) {
+            m_modified.insert(path);
+        }
+    } else if (mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+        bool cached = m_cache->invalidate(path.c_str());
+        cached = m_modified.erase(path) > 0 || cached;
+        // 原来在缓存中的文件立即读入新内容，之后的请求仍然命中
+        if (cached) {
+            cached_file* f = m_cache->load(path.c_str());
+            if (f) {
+                file_cache::release(f);
+            }
+        }
+    } else if (mask & (IN_DELETE | IN_MOVED_FROM)) {
+        m_cache->invalidate(path.c_str());
+        m_modified.erase(path);
+    }
+}
+
+void file_watcher::run() {
+    // 按inotify_event对齐，足够容纳多个带文件名的事件
+    alignas(struct inotify_event) char buf[16 * (sizeof(struct inotify_event) + NAME_MAX + 1)];
+    while (true) {
+        ssize_t n = ::read(m_fd, buf, sizeof(buf));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("inotify read failure, errno is: %d\n", errno);
+            break;
+        }
+        for (char* p = buf; p < buf + n;) {
+            struct inotify_event* ev = (struct inotify_event*)p;
+            if (ev->mask & IN_Q_OVERFLOW) {
+                // 事件队列溢出，不知道丢了哪些变化，整个缓存失效
+                m_cache->clear();
+                m_variants->clear();
+                m_modified.clear();
+            } else {
+                handle(ev->wd, ev->mask, ev->len ? ev->name : NULL);
+            }
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+}
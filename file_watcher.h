@@ -0,0 +1,44 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <pthread.h>
+#include <map>
+#include <set>
+#include <string>
+#include "file_cache.h"
+
+// 用inotify监听资源目录，文件变化时让file_cache中对应的条目失效
+// 请求处理路径上不做任何新旧检查；写入或替换完成(IN_CLOSE_WRITE/IN_MOVED_TO)时，原来在缓存中的文件
+// 立即重新读入，删除或移走时只失效。子目录递归监听，新建或移入的目录自动加入
+// 压缩变体以原文件路径加.gz/.br为键，原文件或预先压缩的同名文件变化时都失效，下次请求时重新生成
+class file_watcher {
+   public:
+    // 单例模式(局部静态变量懒汉模式)
+    static file_watcher* GetInstance();
+
+    // 监听root及其子目录并启动监听线程，返回监听的目录数，失败返回-1
+    int start(const char* root, file_cache* cache, file_cache* variants);
+
+   private:
+    file_watcher() : m_fd(-1), m_cache(NULL), m_variants(NULL) {}
+    ~file_watcher() {}
+
+    static void* worker(void* arg);
+    void run();
+    // 递归监听目录，返回新加入的目录数
+    int watch_dir(const std::string& dir);
+    // 目录被删除或移走，取消它和子目录的监听
+    void unwatch_dir(const std::string& dir);
+    void handle(int wd, unsigned int mask, const char* name);
+    // 文件path变化，失效以它为原文件或以它为键的压缩变体
+    void invalidate_variants(const std::string& path);
+
+    int m_fd;  // inotify实例
+    file_cache* m_cache;
+    file_cache* m_variants;
+    pthread_t m_thread;
+    std::map<int, std::string> m_dirs;  // 监听描述符到目录路径
+    std::set<std::string> m_modified;   // 被IN_MODIFY失效、还没写完的文件，写完后重新读入
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include "http_conn.h"
+#include "uring.h"
 
 // 定义HTTP响应的一些状态信息
 const char* ok_200_title = "OK";
@@ -10,6 +11,58 @@ const char* error_404_title = "Not Found";
 const char* error_404_form = "The requested file was not found on this server.\n";
 const char* error_500_title = "Internal Error";
 const char* error_500_form = "There was an unusual problem serving the requested file.\n";
+const char* error_503_title = "Service Unavailable";
+const char* error_503_form = "The server is overloaded, please try again later.\n";
+
+// 预先生成的503应答
+static char unavailable_response[256];
+static int unavailable_len = 0;
+
+// 预先生成的错误应答，按HTTP_CODE索引；头部不含Date和Connection行，发送时插在头部和正文之间
+static std::string error_heads[http_conn::CLOSED_CONNECTION];
+static std::string error_bodies[http_conn::CLOSED_CONNECTION];
+
+// 按路径前缀匹配的Cache-Control行
+static std::vector<std::pair<std::string, std::string>> cache_controls;
+
+// 扩展名到Content-Type，没有匹配的按二进制流发送；compress为文本类、值得压缩的类型
+static const struct mime_type_t {
+    const char* ext;
+    const char* type;
+    bool compress;
+} mime_types[] = {
+    {"html", "text/html; charset=utf-8", true},
+    {"htm", "text/html; charset=utf-8", true},
+    {"css", "text/css; charset=utf-8", true},
+    {"js", "application/javascript; charset=utf-8", true},
+    {"json", "application/json", true},
+    {"txt", "text/plain; charset=utf-8", true},
+    {"xml", "application/xml", true},
+    {"svg", "image/svg+xml", true},
+    {"wasm", "application/wasm", true},
+    {"png", "image/png", false},
+    {"jpg", "image/jpeg", false},
+    {"jpeg", "image/jpeg", false},
+    {"gif", "image/gif", false},
+    {"ico", "image/x-icon", false},
+    {"webp", "image/webp", false},
+    {"woff", "font/woff", false},
+    {"woff2", "font/woff2", false},
+    {"ttf", "font/ttf", true},
+    {"mp3", "audio/mpeg", false},
+    {"mp4", "video/mp4", false},
+    {"webm", "video/webm", false},
+    {"pdf", "application/pdf", false},
+    {"zip", "application/zip", false},
+};
+static const mime_type_t octet_stream = {"", "application/octet-stream", false};
+
+// 多个范围的206应答中分隔各段的字符串，启动时随机生成
+static char range_boundary[24];
+
+// 应答头部中随请求变化的行，和Date行一起复制进写缓冲区
+static const char conn_keep_alive[] = "Connection: keep-alive\r\n\r\n";
+static const char conn_close[] = "Connection: close\r\n\r\n";
 
 // 网站的根目录
 const char* doc_root = "/home/ljc/webserver/resources";
@@ -17,7 +70,10 @@ const char* doc_root = "/home/ljc/webserver/resources";
 // 将表中的用户名和密码放入map
 map<string, string> users;
 
-// 数据库的互斥锁
+// 正在写库、尚未放入users的用户名
+set<string> registering;
+
+// users和registering的互斥锁
 locker m_lock;
 
 // 从数据库中读入user表
@@ -86,37 +142,68 @@ void modfd(int epollfd, int fd, int ev) {
 }
 
 // 所有的客户数
-int http_conn::m_user_count = 0;
-// 所有socket上的事件都被注册到同一个epoll内核事件中，所以设置成静态的
-int http_conn::m_epollfd = -1;
-
-// 关闭连接
+std::atomic<int> http_conn::m_user_count(0);
+int http_conn::m_max_request = 64 * 1024;
+int http_conn::m_write_budget = 256 * 1024;
+int http_conn::m_io_model = MODEL_PROACTOR;
+http_conn::handoff_fn http_conn::m_handoff = NULL;
+std::atomic<unsigned long> http_conn::m_budget_hits(0);
+int http_conn::m_file_send = FILE_SENDFILE;
+
+// 工作线程调用，关闭连接
+// 不在这里close：fd关闭后可能立即被新连接复用，而定时器和连接对象仍归原reactor管理。
+// 先shutdown再重新监听，reactor线程读到连接关闭后统一关闭fd、删除定时器并回收连接对象
 void http_conn::close_conn() {
     if (m_sockfd != -1) {
-        removefd(m_epollfd, m_sockfd);
-        m_sockfd = -1;
-        m_user_count--;  // 关闭一个连接，将客户总数量-1
+        shutdown(m_sockfd, SHUT_RDWR);
+        rearm(EPOLLIN);
     }
 }
 
-// 主线程调用
-// 初始化连接,外部调用初始化套接字地址
-void http_conn::init(int sockfd, const sockaddr_in& addr) {
+// 连接关闭后由reactor线程调用：释放发送途中留下的文件映射，租用的读写缓冲区还给池，
+// 放回slab的对象只保留内联部分。连接不能在工作线程手中(busy())，否则缓冲区会被转给其他连接后继续写入
+void http_conn::release_buffers() {
+    release_files();
+    m_read_idx = 0;
+    shrink_read_buf();
+    release_write_segs();
+}
+
+// reactor线程调用
+// 初始化连接,外部调用初始化套接字地址，连接注册到接受它的reactor的epoll上
+void http_conn::init(int sockfd, const sockaddr_in& addr, int epollfd, uring_reactor* uring, unsigned int gen) {
     m_sockfd = sockfd;
     m_address = addr;
+    m_epollfd = epollfd;
+    m_uring = uring;
+    m_gen = gen;
 
     // 端口复用
     int reuse = 1;
     setsockopt(m_sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
-    addfd(m_epollfd, sockfd, true);
+    // io_uring后端由reactor线程直接提交recv，不需要注册到epoll
+    if (!m_uring) {
+        addfd(m_epollfd, sockfd, true);
+    }
     m_user_count++;
     init();
 }
 
 void http_conn::init() {
-    mysql = NULL;
     bytes_to_send = 0;
     bytes_have_send = 0;
+    m_iv_count = 0;
+    m_iv_idx = 0;
+    m_clip_len = 0;
+    m_file_count = 0;
+    m_file_fd = -1;
+    m_cached = NULL;
+    m_encoding = ENC_IDENTITY;
+    m_task = TASK_PROCESS;
+    m_lane = LANE_STATIC;
+    m_busy.store(false, std::memory_order_relaxed);
+    m_keep_alive = false;
+    m_more = false;
 
     m_check_state = CHECK_STATE_REQUESTLINE;  // 初始状态为检查请求行
     m_linger = false;
@@ -125,26 +212,32 @@ void http_conn::init() {
     m_url = 0;
     m_version = 0;
     m_content_length = 0;
+    m_header_count = 0;
+    m_known_mask = 0;
     m_host = 0;
     m_start_line = 0;
     m_checked_idx = 0;
     m_read_idx = 0;
+    m_write_cur = m_write_buf;
+    m_write_cap = WRITE_BUFFER_SIZE;
     m_write_idx = 0;
+    m_string = 0;
 
-    bzero(m_read_buf, READ_BUFFER_SIZE);
-    bzero(m_write_buf, READ_BUFFER_SIZE);
-    bzero(m_real_file, FILENAME_LEN);
+    // 缓冲区不再清零：解析只访问[0, m_read_idx)，写缓冲区按m_write_idx追加，
+    // m_real_file由strncpy填充，只需保证最后一个字节是\0
+    m_real_file[FILENAME_LEN - 1] = '\0';
 }
 
 // 循环读取客户数据，直到无数据可读或者对方关闭连接
+// 读缓冲区满时换成更大的块，请求超过m_max_request时关闭连接
 bool http_conn::read() {
-    if (m_read_idx >= READ_BUFFER_SIZE) {
-        return false;
-    }
     int bytes_read = 0;
     while (true) {
-        // 从m_read_buf + m_read_idx索引处开始保存数据，大小是READ_BUFFER_SIZE - m_read_idx
-        bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, READ_BUFFER_SIZE - m_read_idx, 0);
+        if (m_read_idx >= m_read_cap - 1 && !grow_read_buf()) {
+            return false;
+        }
+        // 从m_read_buf + m_read_idx索引处开始保存数据，最后一个字节留给请求体后的\0
+        bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, m_read_cap - 1 - m_read_idx, 0);
         if (bytes_read == -1) {
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
                 // 没有数据
@@ -159,15 +252,474 @@ bool http_conn::read() {
     return true;
 }
 
+// io_uring后端：把内核收到提供缓冲区中的数据追加到读缓冲区
+bool http_conn::append_read(const char* buf, int len) {
+    while (len > m_read_cap - 1 - m_read_idx) {
+        if (!grow_read_buf()) {
+            return false;
+        }
+    }
+    memcpy(m_read_buf + m_read_idx, buf, len);
+    m_read_idx += len;
+    return true;
+}
+
+static void error_page(int code, int status, const char* title, const char* form) {
+    char buf[256];
+    int len = snprintf(buf, sizeof(buf), "HTTP/1.1 %d %s\r\nContent-Length: %d\r\nContent-Type:text/html\r\n",
+                       status, title, (int)strlen(form));
+    error_heads[code].assign(buf, len);
+    error_bodies[code] = form;
+}
+
+void http_conn::init_responses(int retry_after) {
+    std::random_device rd;
+    snprintf(range_boundary, sizeof(range_boundary), "%08x%08x", rd(), rd());
+    error_page(BAD_REQUEST, 400, error_400_title, error_400_form);
+    error_page(FORBIDDEN_REQUEST, 403, error_403_title, error_403_form);
+    error_page(NO_RESOURCE, 404, error_404_title, error_404_form);
+    error_page(INTERNAL_ERROR, 500, error_500_title, error_500_form);
+    unavailable_len = snprintf(unavailable_response, sizeof(unavailable_response),
+                               "HTTP/1.1 503 %s\r\nContent-Length: %d\r\nContent-Type:text/html\r\n"
+                               "Retry-After: %d\r\nConnection: close\r\n\r\n%s",
+                               error_503_title, (int)strlen(error_503_form), retry_after, error_503_form);
+}
+
+// 至少能放下内联缓冲区，最多一个最大的池块
+void http_conn::set_max_request(int bytes) {
+    if (bytes < READ_BUFFER_SIZE) {
+        bytes = READ_BUFFER_SIZE;
+    }
+    if (bytes > buffer_pool::MAX_BLOCK) {
+        bytes = buffer_pool::MAX_BLOCK;
+    }
+    m_max_request = bytes;
+}
+
+void http_conn::set_file_send(int mode) {
+    m_file_send = mode;
+}
+
+void http_conn::set_cache_rules(const cache_rule* rules, int count) {
+    for (int i = 0; i < count; ++i) {
+        char line[64];
+        if (rules[i].max_age == 0) {
+            snprintf(line, sizeof(line), "Cache-Control: no-cache\r\n");
+        } else {
+            snprintf(line, sizeof(line), "Cache-Control: public, max-age=%d\r\n", rules[i].max_age);
+        }
+        cache_controls.push_back(std::make_pair(std::string(rules[i].prefix), std::string(line)));
+    }
+}
+
+// path为完整路径，去掉doc_root后按最长前缀匹配
+static const std::string* cache_control(const char* path) {
+    int root_len = strlen(doc_root);
+    if (strncmp(path, doc_root, root_len) == 0) {
+        path += root_len;
+    }
+    const std::string* line = NULL;
+    size_t longest = 0;
+    for (size_t i = 0; i < cache_controls.size(); ++i) {
+        const std::string& prefix = cache_controls[i].first;
+        if (prefix.size() > longest && strncmp(path, prefix.c_str(), prefix.size()) == 0) {
+            line = &cache_controls[i].second;
+            longest = prefix.size();
+        }
+    }
+    return line;
+}
+
+static const mime_type_t* mime_type(const char* path) {
+    const char* dot = strrchr(path, '.');
+    if (dot && !strchr(dot, '/')) {
+        for (size_t i = 0; i < sizeof(mime_types) / sizeof(mime_types[0]); ++i) {
+            if (strcasecmp(dot + 1, mime_types[i].ext) == 0) {
+                return &mime_types[i];
+            }
+        }
+    }
+    return &octet_stream;
+}
+
+// 会生成压缩变体的文件：启用了变体缓存、文本类、不太小且压缩后放得进变体缓存
+static bool compressible(const mime_type_t* type, off_t size) {
+    file_cache* variants = file_cache::GetVariants();
+    return type->compress && variants->enabled() && size >= http_conn::COMPRESS_MIN && variants->cacheable(size);
+}
+
+template <size_t N>
+static char* put(char* p, const char (&text)[N]) {
+    memcpy(p, text, N - 1);
+    return p + N - 1;
+}
+
+// ETag由修改时间和大小生成(与nginx相同)，压缩的变体加上编码，ex. "5f3c1a2b-f5"、"5f3c1a2b-9c-br"
+static char* etag(char* p, char* end, const struct stat& st, int encoding) {
+    *p++ = '"';
+    p = std::to_chars(p, end, (unsigned long)st.st_mtime, 16).ptr;
+    *p++ = '-';
+    p = std::to_chars(p, end, (unsigned long long)st.st_size, 16).ptr;
+    if (encoding == ENC_GZIP) {
+        p = put(p, "-gz");
+    } else if (encoding == ENC_BR) {
+        p = put(p, "-br");
+    }
+    *p++ = '"';
+    return p;
+}
+
+// Vary、Last-Modified、ETag和Cache-Control，200、206和304应答共用
+static char* put_validators(char* p, char* end, const char* path, const mime_type_t* type, const struct stat& st,
+                            int encoding) {
+    // 同一路径按Accept-Encoding有不同的表示，共享缓存要分开存
+    if (encoding != ENC_IDENTITY || compressible(type, st.st_size)) {
+        p = put(p, "Vary: Accept-Encoding\r\n");
+    }
+    p = put(p, "Last-Modified: ");
+    p = http_date(p, st.st_mtime);
+    p = put(p, "\r\nETag: ");
+    p = etag(p, end, st, encoding);
+    p = put(p, "\r\n");
+    const std::string* cc = cache_control(path);
+    if (cc) {
+        memcpy(p, cc->data(), cc->size());
+        p += cc->size();
+    }
+    return p;
+}
+
+// 只用memcpy和to_chars拼接，不解析格式串；304不带Content-Length、Content-Type和Content-Encoding
+// path为原文件的路径，压缩变体的st为变体的状态(st_size为压缩后的大小)
+static int write_file_header(char* buf, int size, const char* path, const struct stat& st, bool not_modified,
+                             int encoding) {
+    char* p = buf;
+    char* end = buf + size;
+    const mime_type_t* type = mime_type(path);
+    if (not_modified) {
+        p = put(p, "HTTP/1.1 304 Not Modified\r\n");
+    } else {
+        p = put(p, "HTTP/1.1 200 OK\r\nContent-Length: ");
+        p = std::to_chars(p, end, (long long)st.st_size).ptr;
+        p = put(p, "\r\nContent-Type: ");
+        int type_len = strlen(type->type);
+        memcpy(p, type->type, type_len);
+        p = put(p + type_len, "\r\n");
+        if (encoding == ENC_GZIP) {
+            p = put(p, "Content-Encoding: gzip\r\n");
+        } else if (encoding == ENC_BR) {
+            p = put(p, "Content-Encoding: br\r\n");
+        } else {
+            p = put(p, "Accept-Ranges: bytes\r\n");
+        }
+    }
+    p = put_validators(p, end, path, type, st, encoding);
+    return p - buf;
+}
+
+int http_conn::file_header(char* buf, int size, const char* path, const struct stat& st, bool not_modified) {
+    return write_file_header(buf, size, path, st, not_modified, ENC_IDENTITY);
+}
+
+// 变体的键为原文件路径加.gz或.br
+int http_conn::variant_header(char* buf, int size, const char* key, const struct stat& st, bool not_modified) {
+    char path[FILENAME_LEN];
+    int len = strlen(key) - 3;
+    if (len <= 0 || len >= FILENAME_LEN) {
+        return 0;
+    }
+    memcpy(path, key, len);
+    path[len] = '\0';
+    int encoding = strcmp(key + len, ".br") == 0 ? ENC_BR : ENC_GZIP;
+    return write_file_header(buf, size, path, st, not_modified, encoding);
+}
+
+void http_conn::init_compression(size_t capacity) {
+    file_cache::GetVariants()->init(capacity);
+    file_cache::GetVariants()->set_header_builder(variant_header);
+}
+
+// 读入整个文件，供没有缓存的原文件生成压缩变体
+static char* read_file(const char* path, size_t size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    char* data = (char*)malloc(size);
+    size_t got = 0;
+    while (data && got < size) {
+        ssize_t n = ::read(fd, data + got, size - got);
+        if (n <= 0) {
+            break;
+        }
+        got += n;
+    }
+    close(fd);
+    if (data && got != size) {
+        free(data);
+        data = NULL;
+    }
+    return data;
+}
+
+// 客户端接受压缩且文件值得压缩时，把要发送的内容换成变体缓存中的条目，br优先
+// 变体依次来自：变体缓存、doc_root中预先压缩好的同名.br/.gz文件、对原文件压缩一次后放入变体缓存
+bool http_conn::use_variant() {
+    if (!compressible(mime_type(m_real_file), m_file_stat.st_size) || !file_cache::canonical(m_real_file)) {
+        return false;
+    }
+    // 范围请求按原文件计算偏移，不压缩
+    const char* accept = header(H_ACCEPT_ENCODING);
+    if (!accept || header(H_RANGE)) {
+        return false;
+    }
+    int accepted = accepted_encodings(accept);
+    int encoding = (accepted & ENC_BR) ? ENC_BR : (accepted & ENC_GZIP) ? ENC_GZIP : ENC_IDENTITY;
+    if (encoding == ENC_IDENTITY) {
+        return false;
+    }
+    int len = strlen(m_real_file);
+    if (len + 4 > FILENAME_LEN) {
+        return false;
+    }
+    char key[FILENAME_LEN];
+    memcpy(key, m_real_file, len);
+    memcpy(key + len, encoding == ENC_BR ? ".br" : ".gz", 4);
+
+    file_cache* variants = file_cache::GetVariants();
+    cached_file* v = variants->lookup(key);
+    if (!v) {
+        v = variants->load(key);
+    }
+    if (!v) {
+        unsigned long gen = variants->generation(key);
+        const char* src = m_cached ? m_cached->data : NULL;
+        char* owned = NULL;
+        if (!src) {
+            src = owned = read_file(m_real_file, m_file_stat.st_size);
+        }
+        char* out;
+        size_t out_len;
+        bool ok = src && (encoding == ENC_BR ? compress_brotli(src, m_file_stat.st_size, &out, &out_len)
+                                             : compress_gzip(src, m_file_stat.st_size, &out, &out_len));
+        free(owned);
+        if (!ok) {
+            return false;
+        }
+        struct stat st = m_file_stat;
+        st.st_size = out_len;
+        v = variants->insert(key, out, out_len, st, gen);
+    }
+    if (m_cached) {
+        file_cache::release(m_cached);
+    }
+    m_cached = v;
+    m_file_stat = v->st;
+    m_encoding = encoding;
+    return true;
+}
+
+// 有If-None-Match时忽略If-Modified-Since(RFC 7232)；ETag按弱比较，W/前缀不影响
+bool http_conn::not_modified() const {
+    if (m_method != GET) {
+        return false;
+    }
+    const char* tags = header(H_IF_NONE_MATCH);
+    if (tags) {
+        if (tags[0] == '*') {
+            return true;
+        }
+        char tag[48];
+        *etag(tag, tag + sizeof(tag) - 1, m_file_stat, m_encoding) = '\0';
+        return strstr(tags, tag) != NULL;
+    }
+    const char* since = header(H_IF_MODIFIED_SINCE);
+    time_t t;
+    return since && parse_http_date(since, &t) && m_file_stat.st_mtime <= t;
+}
+
+// 非负十进制数，最多18位，不会溢出
+static const char* parse_offset(const char* p, off_t* value) {
+    const char* begin = p;
+    off_t v = 0;
+    while (*p >= '0' && *p <= '9' && p - begin < 18) {
+        v = v * 10 + (*p - '0');
+        ++p;
+    }
+    if (p == begin || (*p >= '0' && *p <= '9')) {
+        return NULL;
+    }
+    *value = v;
+    return p;
+}
+
+// ex. bytes=0-499, 1000-, -200
+// 返回文件内的范围数，0表示没有一个范围在文件内；格式错误或范围太多返回-1，按没有Range处理
+static int parse_ranges(const char* value, off_t size, http_conn::byte_range* out) {
+    if (strncasecmp(value, "bytes=", 6) != 0) {
+        return -1;
+    }
+    const char* p = value + 6;
+    int specs = 0;
+    int n = 0;
+    while (true) {
+        while (*p == ' ' || *p == '\t') {
+            ++p;
+        }
+        if (++specs > http_conn::MAX_RANGES) {
+            return -1;
+        }
+        off_t first, last;
+        if (*p == '-') {
+            // 最后last个字节
+            p = parse_offset(p + 1, &last);
+            if (!p) {
+                return -1;
+            }
+            if (last > 0) {
+                first = last < size ? size - last : 0;
+                out[n].start = first;
+                out[n].len = size - first;
+                ++n;
+            }
+        } else {
+            p = parse_offset(p, &first);
+            if (!p || *p != '-') {
+                return -1;
+            }
+            ++p;
+            if (*p >= '0' && *p <= '9') {
+                p = parse_offset(p, &last);
+                if (!p || last < first) {
+                    return -1;
+                }
+            } else {
+                last = size - 1;
+            }
+            if (first < size) {
+                if (last >= size) {
+                    last = size - 1;
+                }
+                out[n].start = first;
+                out[n].len = last - first + 1;
+                ++n;
+            }
+        }
+        while (*p == ' ' || *p == '\t') {
+            ++p;
+        }
+        if (*p == '\0') {
+            return n;
+        }
+        if (*p != ',') {
+            return -1;
+        }
+        ++p;
+    }
+}
+
+// If-Range为ETag时按强比较，为日期时必须与Last-Modified完全相同
+http_conn::HTTP_CODE http_conn::range_request() {
+    const char* range = header(H_RANGE);
+    if (!range || m_method != GET || m_file_stat.st_size == 0) {
+        return FILE_REQUEST;
+    }
+    const char* if_range = header(H_IF_RANGE);
+    if (if_range) {
+        bool match;
+        if (if_range[0] == '"') {
+            char tag[48];
+            char* end = etag(tag, tag + sizeof(tag), m_file_stat, m_encoding);
+            match = strlen(if_range) == (size_t)(end - tag) && memcmp(if_range, tag, end - tag) == 0;
+        } else {
+            time_t t;
+            match = parse_http_date(if_range, &t) && t == m_file_stat.st_mtime;
+        }
+        // 客户端手里的部分已经过时，发送整个文件
+        if (!match) {
+            return FILE_REQUEST;
+        }
+    }
+    int n = parse_ranges(range, m_file_stat.st_size, m_ranges);
+    if (n < 0) {
+        return FILE_REQUEST;
+    }
+    if (n == 0) {
+        return RANGE_NOT_SATISFIABLE;
+    }
+    m_range_count = n;
+    return PARTIAL_CONTENT;
+}
+
+int http_conn::init_file_cache(size_t capacity, bool preload) {
+    file_cache::GetInstance()->init(capacity);
+    file_cache::GetInstance()->set_header_builder(file_header);
+    if (!preload) {
+        return 0;
+    }
+    return file_cache::GetInstance()->preload(doc_root);
+}
+
+int http_conn::watch_files() {
+    return file_watcher::GetInstance()->start(doc_root, file_cache::GetInstance(), file_cache::GetVariants());
+}
+
+// 应答很短，一次非阻塞send即可放进发送缓冲区，发不出去也不再重试
+void http_conn::send_unavailable(int sockfd) {
+    send(sockfd, unavailable_response, unavailable_len, MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+// reactor线程在把请求交给线程池前调用，此时没有工作线程在处理这个连接
+int http_conn::lane() const {
+    const char* url;
+    const char* end;
+    if (m_check_state != CHECK_STATE_REQUESTLINE && m_url) {
+        // 请求行已被上一次process解析，空格已被改为\0
+        url = m_url;
+        end = url + strlen(url);
+    } else {
+        // ex. POST /2CGISQL.cgi HTTP/1.1，跳过方法，取出URL
+        const char* p = m_read_buf + m_start_line;
+        const char* last = m_read_buf + m_read_idx;
+        while (p < last && *p != ' ' && *p != '\t') ++p;
+        while (p < last && (*p == ' ' || *p == '\t')) ++p;
+        url = p;
+        while (p < last && *p != ' ' && *p != '\t') ++p;
+        if (p == last) {
+            return LANE_STATIC;
+        }
+        end = p;
+    }
+    // 与do_request相同，依据URL中最后一个'/'后面的字符：2为注册，3为登录
+    const char* slash = NULL;
+    for (const char* p = url; p < end; ++p) {
+        if (*p == '/') {
+            slash = p;
+        }
+    }
+    if (!slash || slash + 1 >= end) {
+        return LANE_STATIC;
+    }
+    if (slash[1] == '2') {
+        return LANE_DB;
+    } else if (slash[1] == '3') {
+        return LANE_AUTH;
+    }
+    return LANE_STATIC;
+}
+
 // 从状态机，解析一行，判断依据\r\n
 // 将每一行的末尾\r\n符号改为\0\0，便于主状态机直接取出对应字符串进行处理
+// 用scan_eol直接跳到下一个\r或\n，不再逐字节判断
 http_conn::LINE_STATUS http_conn::parse_line() {
-    char temp;
-    for (; m_checked_idx < m_read_idx; ++m_checked_idx) {
-        // 将要分析的字节
-        temp = m_read_buf[m_checked_idx];
+    const char* end = m_read_buf + m_read_idx;
+    while (m_checked_idx < m_read_idx) {
+        m_checked_idx = scan_eol(m_read_buf + m_checked_idx, end) - m_read_buf;
+        if (m_checked_idx == m_read_idx) {
+            break;
+        }
         // 如果当前是\r字符，则有可能会读取到完整行
-        if (temp == '\r') {
+        if (m_read_buf[m_checked_idx] == '\r') {
             if ((m_checked_idx + 1) == m_read_idx) {
                 return LINE_OPEN;
             } else if (m_read_buf[m_checked_idx + 1] == '\n') {
@@ -177,26 +729,33 @@ http_conn::LINE_STATUS http_conn::parse_line() {
                 return LINE_OK;
             }
             return LINE_BAD;
-        } else if (temp == '\n') { 
-            // 如果当前字符是\n，也有可能读取到完整行，可能是上次读取到\r就到buffer末尾了，没有接收完整，再次接收时会出现这种情况
-            // 前一个字符是\r，则接收完整
-            if ((m_checked_idx > 1) &&
-                (m_read_buf[m_checked_idx - 1] == '\r')) {
-                m_read_buf[m_checked_idx - 1] = '\0';
-                m_read_buf[m_checked_idx++] = '\0';
-                return LINE_OK;
-            }
-            return LINE_BAD;
         }
+        // 如果当前字符是\n，也有可能读取到完整行，可能是上次读取到\r就到buffer末尾了，没有接收完整，再次接收时会出现这种情况
+        // 前一个字符是\r，则接收完整
+        if ((m_checked_idx > 1) && (m_read_buf[m_checked_idx - 1] == '\r')) {
+            m_read_buf[m_checked_idx - 1] = '\0';
+            m_read_buf[m_checked_idx++] = '\0';
+            return LINE_OK;
+        }
+        return LINE_BAD;
     }
     return LINE_OPEN;
 }
 
+// 跳过空格和\t
+static char* skip_blank(char* p, char* end) {
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        ++p;
+    }
+    return p;
+}
+
 // 解析HTTP请求行，获得请求方法、目标URL以及HTTP版本号
-http_conn::HTTP_CODE http_conn::parse_request_line(char* text) {
+// end为行尾(原\r\n所在位置)，按已知长度扫描分隔符
+http_conn::HTTP_CODE http_conn::parse_request_line(char* text, char* end) {
     // ex. GET /index.html HTTP/1.1
-    m_url = strpbrk(text, " \t");  // 判断第二个参数中的字符哪个在text中最先出现
-    if (!m_url) {
+    m_url = (char*)scan_blank(text, end);
+    if (m_url == end) {
         return BAD_REQUEST;
     }
 
@@ -213,15 +772,14 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char* text) {
     } else {
         return BAD_REQUEST;
     }
-    m_url += strspn(m_url, " \t");
+    m_url = skip_blank(m_url, end);
     // /index.html HTTP/1.1
-    // 检索字符串 str1 中第一个不在字符串 str2 中出现的字符下标
-    m_version = strpbrk(m_url, " \t");
-    if (!m_version) {
+    m_version = (char*)scan_blank(m_url, end);
+    if (m_version == end) {
         return BAD_REQUEST;
     }
     *m_version++ = '\0';
-    m_version += strspn(m_version, " \t");
+    m_version = skip_blank(m_version, end);
     if (strcasecmp(m_version, "HTTP/1.1") != 0) {
         return BAD_REQUEST;
     }
@@ -246,9 +804,34 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char* text) {
 }
 
 // 解析HTTP请求头
-http_conn::HTTP_CODE http_conn::parse_headers(char* text) {
+// 每个头部记录为m_read_buf中的(偏移, 长度)，值的末尾改为\0；已知头部再按编号记录一份，
+// 处理函数通过header(H_xxx)直接取值，不再逐个strncasecmp
+http_conn::HTTP_CODE http_conn::parse_headers(char* text, char* end) {
     // 遇到空行，表示头部字段解析完毕
     if (text[0] == '\0') {
+        const char* value;
+        // 处理Connection 头部字段  Connection: keep-alive
+        if ((value = header(H_CONNECTION)) && strcasecmp(value, "keep-alive") == 0) {
+            m_linger = true;
+        }
+        // 处理Content-Length头部字段
+        // 只接受十进制数字；请求体要和头部一起放进读缓冲区，最后一个字节留给请求体后的\0
+        // 长度无效时无法确定请求体在哪里结束，回复400后关闭连接
+        if ((value = header(H_CONTENT_LENGTH))) {
+            char* value_end;
+            errno = 0;
+            long length = strtol(value, &value_end, 10);
+            if (value[0] < '0' || value[0] > '9' || *value_end != '\0' || errno == ERANGE ||
+                length > m_max_request - 1 - m_checked_idx) {
+                m_linger = false;
+                return BAD_REQUEST;
+            }
+            m_content_length = length;
+        }
+        // 处理Host头部字段
+        if ((value = header(H_HOST))) {
+            m_host = (char*)value;
+        }
         // 如果HTTP请求有消息体，则还需要读取m_content_length字节的消息体，
         // 状态机转移到CHECK_STATE_CONTENT状态
         if (m_content_length != 0) {
@@ -257,32 +840,69 @@ http_conn::HTTP_CODE http_conn::parse_headers(char* text) {
         }
         // 得到了一个完整的HTTP请求
         return GET_REQUEST;
-    } else if (strncasecmp(text, "Connection:", 11) == 0) {
-        // 处理Connection 头部字段  Connection: keep-alive
-        text += 11;
-        text += strspn(text, " \t");
-        if (strcasecmp(text, "keep-alive") == 0) {
-            m_linger = true;
-        }
-    } else if (strncasecmp(text, "Content-Length:", 15) == 0) {
-        // 处理Content-Length头部字段
-        text += 15;
-        text += strspn(text, " \t");
-        m_content_length = atol(text);
-    } else if (strncasecmp(text, "Host:", 5) == 0) {
-        // 处理Host头部字段
-        text += 5;
-        text += strspn(text, " \t");
-        m_host = text;
-    } else {
-        // printf("other header... %s\n", text);
+    }
+
+    // name: value，没有冒号的行忽略
+    char* colon = (char*)memchr(text, ':', end - text);
+    if (!colon) {
+        return NO_REQUEST;
+    }
+    char* value = skip_blank(colon + 1, end);
+    char* value_end = end;
+    while (value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t')) {
+        --value_end;
+    }
+    *value_end = '\0';
+
+    header_view h;
+    h.name_off = text - m_read_buf;
+    h.name_len = colon - text;
+    h.value_off = value - m_read_buf;
+    h.value_len = value_end - value;
+    int id = header_id(text, h.name_len);
+    if (id != H_UNKNOWN && !(m_known_mask & (1u << id))) {
+        m_known[id] = h;
+        m_known_mask |= 1u << id;
+    }
+    if (m_header_count < MAX_HEADERS) {
+        m_headers[m_header_count++] = h;
     }
     return NO_REQUEST;
 }
 
+const char* http_conn::header(int id, int* len) const {
+    if (!(m_known_mask & (1u << id))) {
+        return NULL;
+    }
+    if (len) {
+        *len = m_known[id].value_len;
+    }
+    return m_read_buf + m_known[id].value_off;
+}
+
+const char* http_conn::header(const char* name, int* len) const {
+    int name_len = strlen(name);
+    int id = header_id(name, name_len);
+    if (id != H_UNKNOWN) {
+        return header(id, len);
+    }
+    for (int i = 0; i < m_header_count; ++i) {
+        const header_view& h = m_headers[i];
+        if (h.name_len == name_len && strncasecmp(m_read_buf + h.name_off, name, name_len) == 0) {
+            if (len) {
+                *len = h.value_len;
+            }
+            return m_read_buf + h.value_off;
+        }
+    }
+    return NULL;
+}
+
 // 解析请求体 (判断http请求是否被完整读入)
 http_conn::HTTP_CODE http_conn::parse_content(char* text) {
     if (m_read_idx >= (m_content_length + m_checked_idx)) {
+        // 后面可能紧跟着下一个流水线请求，记下被覆盖的字节
+        m_body_end = text[m_content_length];
         text[m_content_length] = '\0';
         // POST请求中最后为输入的用户名和密码
         m_string = text;
@@ -301,17 +921,19 @@ http_conn::HTTP_CODE http_conn::process_read() {
     while (((m_check_state == CHECK_STATE_CONTENT) && (line_status == LINE_OK)) || ((line_status = parse_line()) == LINE_OK)) {
         // 获取一行数据
         text = get_line();
+        // 行尾：parse_line返回LINE_OK时m_checked_idx位于\r\n之后
+        char* line_end = m_read_buf + m_checked_idx - 2;
         // m_start_line是每一个数据行在m_read_buf中的起始位置
         // m_checked_idx表示从状态机在m_read_buf中读取的位置
         m_start_line = m_checked_idx;
         // info
-        printf("http line: %s\n", text);
+        // printf("http line: %s\n", text);
 
         // 主状态机的三种状态转移逻辑
         switch (m_check_state) {
             case CHECK_STATE_REQUESTLINE: {
                 // 解析请求行
-                ret = parse_request_line(text);
+                ret = parse_request_line(text, line_end);
                 if (ret == BAD_REQUEST) {
                     return BAD_REQUEST;
                 }
@@ -319,7 +941,7 @@ http_conn::HTTP_CODE http_conn::process_read() {
             }
             case CHECK_STATE_HEADER: {
                 //解析请求头
-                ret = parse_headers(text);
+                ret = parse_headers(text, line_end);
                 if (ret == BAD_REQUEST) {
                     return BAD_REQUEST;
                 } else if (ret == GET_REQUEST) {
@@ -348,8 +970,9 @@ http_conn::HTTP_CODE http_conn::process_read() {
 }
 
 // 当得到一个完整、正确的HTTP请求时，分析目标文件的属性
-// 如果目标文件存在、对所有用户可读，且不是目录，则使用mmap将其映射到内存地址m_file_address处，并告诉调用者获取文件成功
+// 如果目标文件存在、对所有用户可读，且不是目录，则从缓存中取得或打开该文件，并告诉调用者获取文件成功
 http_conn::HTTP_CODE http_conn::do_request() {
+    m_encoding = ENC_IDENTITY;
     // 根目录：/home/ljc/webserver/resources
     strcpy(m_real_file, doc_root);
     int len = strlen(doc_root);
@@ -363,11 +986,9 @@ http_conn::HTTP_CODE http_conn::do_request() {
         // 0表示注册、1表示登录、2表示注册检验、3表示登录检验
         char flag = m_url[1];
 
-        char* m_url_real = (char*)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/");
-        strcat(m_url_real, m_url + 2);
+        char m_url_real[FILENAME_LEN];
+        snprintf(m_url_real, sizeof(m_url_real), "/%s", m_url + 2);
         strncpy(m_real_file + len, m_url_real, FILENAME_LEN - len - 1);
-        free(m_url_real);
 
         // 将用户名和密码提取出来
         // ex. user=123&passwd=123
@@ -387,7 +1008,7 @@ http_conn::HTTP_CODE http_conn::do_request() {
         // 登录注册相关
         if (*(p + 1) == '2') {
             // 注册
-            char* sql_insert = (char*)malloc(sizeof(char) * 200);
+            char sql_insert[256];
             strcpy(sql_insert, "INSERT INTO user(username, passwd) VALUES(");
             strcat(sql_insert, "'");
             strcat(sql_insert, name);
@@ -395,12 +1016,28 @@ http_conn::HTTP_CODE http_conn::do_request() {
             strcat(sql_insert, password);
             strcat(sql_insert, "')");
 
+            // 查重时加互斥锁，并把用户名登记为正在注册，避免同名并发注册
+            m_lock.lock();
+            bool dup = users.find(name) != users.end() || registering.count(name);
+            if (!dup) {
+                registering.insert(name);
+            }
+            m_lock.unlock();
+
             // 没有重复的用户，可以注册
-            if (users.find(name) == users.end()) {
-                // 插入要加互斥锁
+            if (!dup) {
+                // 只在真正写库时才从连接池取连接，查询结束即归还；查询期间不持有m_lock
+                int res;
+                {
+                    MYSQL* mysql = NULL;
+                    connectionRAII mysqlcon(&mysql, connection_pool::GetInstance());
+                    res = mysql ? mysql_query(mysql, sql_insert) : 1;
+                }
                 m_lock.lock();
-                int res = mysql_query(mysql, sql_insert);
-                users.insert(pair<string, string>(name, password));
+                registering.erase(name);
+                if (!res) {
+                    users.insert(pair<string, string>(name, password));
+                }
                 m_lock.unlock();
                 if (!res) {
                     // 注册成功
@@ -414,9 +1051,13 @@ http_conn::HTTP_CODE http_conn::do_request() {
                 strcpy(m_url, "/registerError.html");
             }
         }
-        // 登录
+        // 登录，只查内存中的users，不访问数据库
         else if (*(p + 1) == '3') {
-            if (users.find(name) != users.end() && users[name] == password)
+            m_lock.lock();
+            map<string, string>::iterator it = users.find(name);
+            bool ok = it != users.end() && it->second == password;
+            m_lock.unlock();
+            if (ok)
                 strcpy(m_url, "/welcome.html");
             else
                 strcpy(m_url, "/loginError.html");
@@ -424,21 +1065,26 @@ http_conn::HTTP_CODE http_conn::do_request() {
     }
 
     if (*(p + 1) == '0') {
-        char* m_url_real = (char*)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/register.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
-        free(m_url_real);
+        strncpy(m_real_file + len, "/register.html", FILENAME_LEN - len - 1);
     } else if (*(p + 1) == '1') {
-        char* m_url_real = (char*)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/login.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
-        free(m_url_real);
+        strncpy(m_real_file + len, "/login.html", FILENAME_LEN - len - 1);
     }  else {
         // 直接拼接，请求资源，ex. index.html、login.html、register.html
         strncpy(m_real_file + len, m_url, FILENAME_LEN - len - 1);
     }
         
 
+    // 缓存命中时不访问文件系统，缓存中只有其他用户可读的普通文件
+    file_cache* cache = file_cache::GetInstance();
+    if (cache->enabled()) {
+        m_cached = cache->lookup(m_real_file);
+        if (m_cached) {
+            m_file_stat = m_cached->st;
+            use_variant();
+            return not_modified() ? NOT_MODIFIED : range_request();
+        }
+    }
+
     //通过stat获取请求资源文件信息，成功则将信息更新到m_file_stat结构体
     //失败返回NO_RESOURCE状态，表示资源不存在
     if (stat(m_real_file, &m_file_stat) < 0) {
@@ -455,212 +1101,736 @@ http_conn::HTTP_CODE http_conn::do_request() {
         return BAD_REQUEST;
     }
 
-    // 以只读方式获取文件描述符，通过mmap将该文件映射到内存中
+    // 客户端缓存的版本仍然有效时不读文件
+    if (use_variant()) {
+        return not_modified() ? NOT_MODIFIED : FILE_REQUEST;
+    }
+    if (not_modified()) {
+        return NOT_MODIFIED;
+    }
+
+    // 未命中时读入缓存，之后的请求直接从内存发送；太大的文件不缓存
+    if (cache->cacheable(m_file_stat.st_size)) {
+        m_cached = cache->load(m_real_file);
+        if (m_cached) {
+            m_file_stat = m_cached->st;
+            return range_request();
+        }
+    }
+
+    // 以只读方式获取文件描述符，空文件只发送头部
     int fd = open(m_real_file, O_RDONLY);
-    m_file_address = (char*)mmap(0, m_file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-    close(fd);
+    if (fd < 0) {
+        return NO_RESOURCE;
+    }
+    if (m_file_stat.st_size == 0) {
+        close(fd);
+        return FILE_REQUEST;
+    }
+    // 保留文件描述符：sendfile方式由内核从页缓存直接发送，mmap方式发送时按窗口映射
+    m_file_fd = fd;
+    return range_request();
+}
 
-    // 表示请求文件存在，且可以访问
-    return FILE_REQUEST;
+// 释放文件：解除窗口映射，释放缓存条目的引用，关闭打开的文件，
+// 包括已排队发送的和刚生成还没排队的
+void http_conn::release_files() {
+    for (int i = 0; i < m_file_count; ++i) {
+        queued_file* f = &m_files[i];
+        if (f->map) {
+            munmap(f->map, f->map_len);
+        }
+        if (f->owner) {
+            if (f->cached) {
+                file_cache::release(f->cached);
+            } else {
+                close(f->fd);
+            }
+        }
+    }
+    m_file_count = 0;
+    if (m_file_fd != -1) {
+        close(m_file_fd);
+        m_file_fd = -1;
+    }
+    if (m_cached) {
+        file_cache::release(m_cached);
+        m_cached = NULL;
+    }
 }
 
-// 对内存映射区执行unmap操作
-void http_conn::unmap() {
-    if (m_file_address) {
-        munmap(m_file_address, m_file_stat.st_size);
-        m_file_address = 0;
+// 缓存的文件直接指向内存；sendfile方式的文件块没有地址，发送时由m_iv_file找到偏移；
+// mmap方式先映射第一个窗口，其余部分发完一个窗口再映射下一个，一个连接最多占用一个窗口
+bool http_conn::queue_file(cached_file* cached, int fd, off_t start, size_t len, bool owner) {
+    int idx = m_file_count++;
+    queued_file* f = &m_files[idx];
+    f->cached = cached;
+    f->fd = fd;
+    f->owner = owner;
+    f->map = NULL;
+    f->map_len = 0;
+    f->offset = start;
+    f->rest = 0;
+    if (cached) {
+        push_iov(cached->data + start, len);
+        return true;
+    }
+    if (!m_uring && m_file_send == FILE_SENDFILE) {
+        push_iov(NULL, len, idx);
+        return true;
+    }
+    f->rest = len;
+    struct iovec window;
+    if (!map_window(idx, &window)) {
+        return false;
+    }
+    push_iov((char*)window.iov_base, window.iov_len, idx);
+    bytes_to_send += f->rest;
+    return true;
+}
+
+bool http_conn::map_window(int file, struct iovec* iv) {
+    static const off_t page_mask = ~(off_t)(sysconf(_SC_PAGESIZE) - 1);
+    queued_file* f = &m_files[file];
+    if (f->map) {
+        munmap(f->map, f->map_len);
+        f->map = NULL;
     }
+    // 映射的起点按页对齐
+    off_t aligned = f->offset & page_mask;
+    size_t skip = f->offset - aligned;
+    size_t len = f->rest < (size_t)STREAM_WINDOW ? f->rest : STREAM_WINDOW;
+    void* addr = mmap(0, skip + len, PROT_READ, MAP_PRIVATE, f->fd, aligned);
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+    f->map = (char*)addr;
+    f->map_len = skip + len;
+    f->offset += len;
+    f->rest -= len;
+    iv->iov_base = f->map + skip;
+    iv->iov_len = len;
+    return true;
 }
 
 // 写HTTP响应
-bool http_conn::write() {
-    int temp = 0;
+// 每次调用最多发送m_write_budget字节，还没发完时重新注册EPOLLOUT后返回，
+// 大文件的快速客户端不会长时间占住reactor线程，其他就绪连接的小应答不必等它发完
+http_conn::WRITE_STATE http_conn::write() {
+    long long temp = 0;
+    long long budget = m_write_budget > 0 ? m_write_budget : LLONG_MAX;
+    long long sent = 0;
 
     if (bytes_to_send == 0) {
         // 将要发送的字节为0，这一次响应结束。
-        modfd(m_epollfd, m_sockfd, EPOLLIN);
-        init();
-        return true;
+        WRITE_STATE state = finish_write();
+        if (state == WRITE_READ) {
+            rearm(EPOLLIN);
+        }
+        return state;
     }
 
     while (1) {
-        // 将响应报文的状态行、消息头、空行和响应正文发送给浏览器端
-        temp = writev(m_sockfd, m_iv, m_iv_count);
+        struct iovec* iv = m_iv + m_iv_idx;
+        if (iv->iov_base) {
+            // 将连续的状态行、消息头、空行和(mmap方式的)响应正文一次发送给浏览器端
+            int count = clip_iov(gather_count(), budget - sent);
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iv;
+            msg.msg_iovlen = count;
+            // 后面紧跟sendfile的文件时带MSG_MORE，头部和文件开头合并成满的TCP段
+            temp = sendmsg(m_sockfd, &msg, m_iv_idx + count < m_iv_count || m_clip_len ? MSG_MORE : 0);
+            unclip();
+        } else {
+            // sendfile从文件的当前偏移继续发送，偏移由内核更新，EAGAIN后下次从这里继续
+            queued_file* f = &m_files[m_iv_file[m_iv_idx]];
+            size_t len = iv->iov_len;
+            if ((long long)len > budget - sent) {
+                len = budget - sent;
+            }
+            temp = sendfile(m_sockfd, f->fd, &f->offset, len);
+            if (temp == 0) {
+                // 文件在发送途中被截短
+                release_files();
+                return WRITE_CLOSE;
+            }
+        }
         if (temp <= -1) {
             // 写缓冲区满了，等待下一轮EPOLLOUT事件
             // 服务器无法立即接收到同一客户的下一个请求，但可以保证连接的完整性。
             if (errno == EAGAIN) {
-                modfd(m_epollfd, m_sockfd, EPOLLOUT);
-                return true;
+                rearm(EPOLLOUT);
+                return WRITE_AGAIN;
             }
-            // 发送失败，但不是缓冲区问题，取消映射
-            unmap();
-            return false;
+            // 发送失败，但不是缓冲区问题，释放文件
+            release_files();
+            return WRITE_CLOSE;
         }
 
-        bytes_have_send += temp;
-        bytes_to_send -= temp;
-
-        // 第一个iovec头部信息的数据已发送完，发送第二个iovec数据
-        if (bytes_have_send >= m_iv[0].iov_len) {
-            m_iv[0].iov_len = 0;
-            m_iv[1].iov_base = m_file_address + (bytes_have_send - m_write_idx);
-            m_iv[1].iov_len = bytes_to_send;
-        } else {
-            // 继续发送第一个iovec头部信息的数据
-            m_iv[0].iov_base = m_write_buf + bytes_have_send;
-            m_iv[0].iov_len = m_iv[0].iov_len - temp;
-        }
-
-        if (bytes_to_send <= 0) {
-            // 没有数据要发送了
-            unmap();
-            modfd(m_epollfd, m_sockfd, EPOLLIN);
-
-            // 长连接则重新初始化http对象
-            if (m_linger) {
-                init();
-                return true;
-            } else {
-                return false;
+        if (advance_write(temp)) {
+            // 没有数据要发送了，缓冲区中还有完整请求时交给reactor线程再次分发，不需要等待可读
+            WRITE_STATE state = finish_write();
+            if (state == WRITE_READ) {
+                rearm(EPOLLIN);
             }
+            return state;
+        }
+        sent += temp;
+        if (sent >= budget) {
+            // socket仍然可写，重新注册后由下一次epoll_wait返回，排在已经就绪的连接之后
+            m_budget_hits.fetch_add(1, std::memory_order_relaxed);
+            rearm(EPOLLOUT);
+            return WRITE_YIELD;
         }
     }
 }
 
-// 往写缓冲中写入待发送的数据
-bool http_conn::add_response(const char* format, ...) {
-    if (m_write_idx >= WRITE_BUFFER_SIZE) {
-        return false;
+// io_uring后端一次writev在提交时由内核直接拷贝，也按预算截短，剩下的在完成后作为新的请求提交
+struct iovec* http_conn::write_iov(int* count) {
+    int n = gather_count();
+    *count = clip_iov(n, m_write_budget > 0 ? m_write_budget : LLONG_MAX);
+    if (*count < n || m_clip_len) {
+        m_budget_hits.fetch_add(1, std::memory_order_relaxed);
     }
-    va_list arg_list;
-    va_start(arg_list, format);
-    // 将数据format从可变参数列表写入缓冲区写，返回写入数据的长度
-    int len = vsnprintf(m_write_buf + m_write_idx, WRITE_BUFFER_SIZE - 1 - m_write_idx, format, arg_list);
-    if (len >= (WRITE_BUFFER_SIZE - 1 - m_write_idx)) {
-        return false;
+    return m_iv + m_iv_idx;
+}
+
+int http_conn::clip_iov(int count, long long budget) {
+    for (int i = 0; i < count; ++i) {
+        struct iovec* iv = &m_iv[m_iv_idx + i];
+        if ((long long)iv->iov_len >= budget) {
+            if ((long long)iv->iov_len > budget) {
+                m_clip_idx = m_iv_idx + i;
+                m_clip_len = iv->iov_len - budget;
+                iv->iov_len = budget;
+            }
+            return i + 1;
+        }
+        budget -= iv->iov_len;
     }
-    m_write_idx += len;
-    va_end(arg_list);
-    return true;
+    return count;
 }
 
-// 添加状态行
-bool http_conn::add_status_line(int status, const char* title) {
-    return add_response("%s %d %s\r\n", "HTTP/1.1", status, title);
+void http_conn::unclip() {
+    if (m_clip_len) {
+        m_iv[m_clip_idx].iov_len += m_clip_len;
+        m_clip_len = 0;
+    }
 }
 
-// 添加头部(响应报文长度、类型、是否长连接、空行)
-bool http_conn::add_headers(int content_len) {
-    add_content_length(content_len);
-    add_content_type();
-    add_linger();
-    add_blank_line();
+// 一个文件的窗口发完后要先映射下一个窗口，后面的iovec不能和它一起发送
+int http_conn::gather_count() const {
+    int count = 0;
+    while (m_iv_idx + count < m_iv_count) {
+        int i = m_iv_idx + count;
+        if (!m_iv[i].iov_base) {
+            break;
+        }
+        ++count;
+        int file = m_iv_file[i];
+        if (file >= 0 && m_files[file].rest > 0) {
+            break;
+        }
+    }
+    return count;
 }
 
-// content-length
-bool http_conn::add_content_length(int content_len) {
-    return add_response("Content-Length: %d\r\n", content_len);
+// 已发送bytes字节，跳过已发完的iovec，调整第一个未发完的iovec的起始位置和长度
+// sendfile方式的文件块只调整长度；mmap方式的文件块发完一个窗口时映射下一个，iovec不前进
+bool http_conn::advance_write(int bytes) {
+    unclip();
+    bytes_have_send += bytes;
+    bytes_to_send -= bytes;
+
+    while (bytes > 0 && m_iv_idx < m_iv_count) {
+        struct iovec* iv = &m_iv[m_iv_idx];
+        if ((size_t)bytes >= iv->iov_len) {
+            bytes -= iv->iov_len;
+            iv->iov_len = 0;
+            int file = m_iv_file[m_iv_idx];
+            if (file >= 0 && m_files[file].rest > 0) {
+                if (!map_window(file, iv)) {
+                    // 无法继续发送，放弃剩下的数据并关闭连接，客户端按Content-Length能发现应答不完整
+                    bytes_to_send = 0;
+                    m_keep_alive = false;
+                    return true;
+                }
+                continue;
+            }
+            ++m_iv_idx;
+        } else {
+            if (iv->iov_base) {
+                iv->iov_base = (char*)iv->iov_base + bytes;
+            }
+            iv->iov_len -= bytes;
+            bytes = 0;
+        }
+    }
+    return bytes_to_send <= 0;
 }
 
-// 是否长连接
-bool http_conn::add_linger() {
-    return add_response("Connection: %s\r\n", (m_linger == true) ? "keep-alive" : "close");
+// 应答发送完毕，释放文件，清空写缓冲区；读缓冲区中的后续请求已由response_done移到开头
+http_conn::WRITE_STATE http_conn::finish_write() {
+    release_files();
+    release_write_segs();
+    m_iv_count = 0;
+    m_iv_idx = 0;
+    bytes_to_send = 0;
+    bytes_have_send = 0;
+    if (!m_keep_alive) {
+        return WRITE_CLOSE;
+    }
+    if (m_more) {
+        m_more = false;
+        return WRITE_PROCESS;
+    }
+    return WRITE_READ;
 }
 
-// 空行
-bool http_conn::add_blank_line() {
-    return add_response("%s", "\r\n");
+// 往写缓冲中复制待发送的数据，并追加到待发送的iovec中
+// 当前段放不下时整块写到新租用的一段，一块不会跨段
+bool http_conn::add_bytes(const char* data, int len) {
+    if (len > m_write_cap - m_write_idx) {
+        if (len > buffer_pool::MIN_BLOCK || !next_write_seg()) {
+            return false;
+        }
+    }
+    memcpy(m_write_cur + m_write_idx, data, len);
+    push_iov(m_write_cur + m_write_idx, len);
+    m_write_idx += len;
+    return true;
 }
 
-// 文本内容
-bool http_conn::add_content(const char* content) {
-    return add_response("%s", content);
+// Date行每秒变化且属于当前线程，不能像其他预先生成的内容一样直接引用
+bool http_conn::add_connection() {
+    char buf[coarse_clock::DATE_LINE_LEN + sizeof(conn_keep_alive)];
+    memcpy(buf, coarse_clock::date_line(), coarse_clock::DATE_LINE_LEN);
+    int len = coarse_clock::DATE_LINE_LEN;
+    if (m_linger) {
+        memcpy(buf + len, conn_keep_alive, sizeof(conn_keep_alive) - 1);
+        len += sizeof(conn_keep_alive) - 1;
+    } else {
+        memcpy(buf + len, conn_close, sizeof(conn_close) - 1);
+        len += sizeof(conn_close) - 1;
+    }
+    return add_bytes(buf, len);
 }
 
-// 类型 html
-bool http_conn::add_content_type() {
-    return add_response("Content-Type:%s\r\n", "text/html");
+// 追加一个待发送的块，与上一个块在内存中相邻时直接合并(相邻的应答头部)
+void http_conn::push_iov(const char* base, size_t len, int file) {
+    if (m_iv_count > 0 && base && file < 0 && m_iv_file[m_iv_count - 1] < 0) {
+        struct iovec* last = &m_iv[m_iv_count - 1];
+        if (last->iov_base && (char*)last->iov_base + last->iov_len == base) {
+            last->iov_len += len;
+            bytes_to_send += len;
+            return;
+        }
+    }
+    m_iv[m_iv_count].iov_base = (char*)base;
+    m_iv[m_iv_count].iov_len = len;
+    m_iv_file[m_iv_count] = file;
+    m_iv_count++;
+    bytes_to_send += len;
 }
 
 // 根据服务器处理HTTP请求的结果，决定返回给客户端的内容
+// 错误页和缓存文件的头部是预先生成的，直接作为iovec发送；只有未缓存文件的头部写进写缓冲区
 bool http_conn::process_write(HTTP_CODE ret) {
     switch (ret) {
-        // 内部错误500
+        // 内部错误500、报文语法错误400、资源不存在404、没有权限403
         case INTERNAL_ERROR:
-            add_status_line(500, error_500_title);
-            add_headers(strlen(error_500_form));
-            if (!add_content(error_500_form)) {
-                return false;
-            }
-            break;
-        // 报文语法错误400
         case BAD_REQUEST:
-            add_status_line(400, error_400_title);
-            add_headers(strlen(error_400_form));
-            if (!add_content(error_400_form)) {
-                return false;
-            }
-            break;
-        // 资源不存在404
         case NO_RESOURCE:
-            add_status_line(404, error_404_title);
-            add_headers(strlen(error_404_form));
-            if (!add_content(error_404_form)) {
-                return false;
-            }
-            break;
-        // 没有权限403
-        case FORBIDDEN_REQUEST:
-            add_status_line(403, error_403_title);
-            add_headers(strlen(error_403_form));
-            if (!add_content(error_403_form)) {
+        case FORBIDDEN_REQUEST: {
+            push_iov(error_heads[ret].data(), error_heads[ret].size());
+            if (!add_connection()) {
                 return false;
             }
-            break;
+            push_iov(error_bodies[ret].data(), error_bodies[ret].size());
+            return true;
+        }
         // 文件存在200
         case FILE_REQUEST:
-            add_status_line(200, ok_200_title);
-            add_headers(m_file_stat.st_size);
-            // 第一个iovec指针指向响应报文缓冲区，长度指向m_write_idx
-            m_iv[0].iov_base = m_write_buf;
-            m_iv[0].iov_len = m_write_idx;
-            // 第二个iovec指针指向mmap返回的文件指针，长度指向文件大小
-            m_iv[1].iov_base = m_file_address;
-            m_iv[1].iov_len = m_file_stat.st_size;
-            m_iv_count = 2;
-
-            bytes_to_send = m_write_idx + m_file_stat.st_size;
-
+            if (m_cached) {
+                push_iov(m_cached->header.data(), m_cached->header.size());
+            } else {
+                char header[file_cache::HEADER_MAX];
+                if (!add_bytes(header, file_header(header, sizeof(header), m_real_file, m_file_stat, false))) {
+                    return false;
+                }
+            }
+            if (!add_connection()) {
+                return false;
+            }
+            // 文件指向缓存的内容或打开的文件，空文件只有头部；文件交给m_files后由release_files释放
+            if (m_file_stat.st_size > 0) {
+                bool ok = queue_file(m_cached, m_file_fd, 0, m_file_stat.st_size, true);
+                m_cached = NULL;
+                m_file_fd = -1;
+                if (!ok) {
+                    return false;
+                }
+            }
             return true;
+        // 部分内容206
+        case PARTIAL_CONTENT:
+            return add_partial();
+        // 范围不满足416
+        case RANGE_NOT_SATISFIABLE:
+            return add_unsatisfiable();
+        // 客户端缓存仍然有效304，只有头部；缓存条目的头部复制后即释放引用
+        case NOT_MODIFIED: {
+            bool ok;
+            if (m_cached) {
+                ok = add_bytes(m_cached->not_modified.data(), m_cached->not_modified.size());
+                file_cache::release(m_cached);
+                m_cached = NULL;
+            } else {
+                char header[file_cache::HEADER_MAX];
+                ok = add_bytes(header, file_header(header, sizeof(header), m_real_file, m_file_stat, true));
+            }
+            return ok && add_connection();
+        }
         default:
             return false;
     }
+}
+
+// 一个范围的Content-Range值，ex. bytes 0-499/1234
+static char* put_content_range(char* p, char* end, const http_conn::byte_range& r, off_t size) {
+    p = put(p, "bytes ");
+    p = std::to_chars(p, end, (long long)r.start).ptr;
+    *p++ = '-';
+    p = std::to_chars(p, end, (long long)(r.start + r.len - 1)).ptr;
+    *p++ = '/';
+    return std::to_chars(p, end, (long long)size).ptr;
+}
+
+// 一个范围时直接发送该段；多个范围时按multipart/byteranges，每段前有段头，最后是结束分隔行
+// 各段共用一个文件，只有第一段负责释放
+bool http_conn::add_partial() {
+    off_t size = m_file_stat.st_size;
+    const mime_type_t* type = mime_type(m_real_file);
+    int type_len = strlen(type->type);
+    int boundary_len = strlen(range_boundary);
+    char header[file_cache::HEADER_MAX];
+    char* p = header;
+    char* end = header + sizeof(header);
+    p = put(p, "HTTP/1.1 206 Partial Content\r\n");
+    // 多个范围的段头先生成好，用来计算Content-Length
+    char parts[MAX_RANGES][256];
+    int part_len[MAX_RANGES];
+    long long length;
+    if (m_range_count == 1) {
+        p = put(p, "Content-Type: ");
+        memcpy(p, type->type, type_len);
+        p = put(p + type_len, "\r\nContent-Range: ");
+        p = put_content_range(p, end, m_ranges[0], size);
+        length = m_ranges[0].len;
+    } else {
+        length = 4 + boundary_len + 4;  // 结束分隔行\r\n--boundary--\r\n
+        for (int i = 0; i < m_range_count; ++i) {
+            char* q = parts[i];
+            q = put(q, "\r\n--");
+            memcpy(q, range_boundary, boundary_len);
+            q = put(q + boundary_len, "\r\nContent-Type: ");
+            memcpy(q, type->type, type_len);
+            q = put(q + type_len, "\r\nContent-Range: ");
+            q = put_content_range(q, parts[i] + sizeof(parts[i]), m_ranges[i], size);
+            q = put(q, "\r\n\r\n");
+            part_len[i] = q - parts[i];
+            length += part_len[i] + m_ranges[i].len;
+        }
+        p = put(p, "Content-Type: multipart/byteranges; boundary=");
+        memcpy(p, range_boundary, boundary_len);
+        p += boundary_len;
+    }
+    p = put(p, "\r\nContent-Length: ");
+    p = std::to_chars(p, end, length).ptr;
+    p = put(p, "\r\n");
+    p = put_validators(p, end, m_real_file, type, m_file_stat, ENC_IDENTITY);
+    if (!add_bytes(header, p - header) || !add_connection()) {
+        return false;
+    }
+
+    cached_file* cached = m_cached;
+    int fd = m_file_fd;
+    m_cached = NULL;
+    m_file_fd = -1;
+    for (int i = 0; i < m_range_count; ++i) {
+        if (m_range_count > 1 && !add_bytes(parts[i], part_len[i])) {
+            // 文件已交给第一段，由release_files释放
+            if (i == 0) {
+                m_cached = cached;
+                m_file_fd = fd;
+            }
+            return false;
+        }
+        if (!queue_file(cached, fd, m_ranges[i].start, m_ranges[i].len, i == 0)) {
+            return false;
+        }
+    }
+    if (m_range_count > 1) {
+        char closing[64];
+        p = put(closing, "\r\n--");
+        memcpy(p, range_boundary, boundary_len);
+        p = put(p + boundary_len, "--\r\n");
+        if (!add_bytes(closing, p - closing)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 416应答带上文件的实际大小，不发送文件
+bool http_conn::add_unsatisfiable() {
+    char header[128];
+    char* p = put(header, "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */");
+    p = std::to_chars(p, header + sizeof(header), (long long)m_file_stat.st_size).ptr;
+    p = put(p, "\r\nContent-Length: 0\r\n");
+    // 只释放本请求打开的文件，同一批中已排队的流水线应答还要发送
+    if (m_cached) {
+        file_cache::release(m_cached);
+        m_cached = NULL;
+    }
+    if (m_file_fd != -1) {
+        close(m_file_fd);
+        m_file_fd = -1;
+    }
+    if (!add_bytes(header, p - header) || !add_connection()) {
+        return false;
+    }
+    return true;
+}
+
+// 一个请求的应答已排队：记下该请求是否保持连接，丢弃已解析的字节，
+// 把紧跟其后的流水线请求移到读缓冲区开头，重置解析状态
+void http_conn::response_done() {
+    m_keep_alive = m_linger;
+    int consumed = m_checked_idx;
+    if (m_check_state == CHECK_STATE_CONTENT) {
+        consumed += m_content_length;
+        if (consumed < m_read_idx) {
+            m_read_buf[consumed] = m_body_end;
+        }
+    }
+    if (consumed < 0) {
+        consumed = 0;
+    } else if (consumed > m_read_idx) {
+        consumed = m_read_idx;
+    }
+    m_read_idx -= consumed;
+    memmove(m_read_buf, m_read_buf + consumed, m_read_idx);
+    shrink_read_buf();
+
+    m_check_state = CHECK_STATE_REQUESTLINE;
+    m_linger = false;
+    m_method = GET;
+    m_url = 0;
+    m_version = 0;
+    m_content_length = 0;
+    m_header_count = 0;
+    m_known_mask = 0;
+    m_host = 0;
+    m_string = 0;
+    m_start_line = 0;
+    m_checked_idx = 0;
+}
 
-    // 除FILE_REQUEST状态外，其余请求出错的状态只申请一个iovec，指向响应报文缓冲区
-    m_iv[0].iov_base = m_write_buf;
-    m_iv[0].iov_len = m_write_idx;
-    m_iv_count = 1;
-    bytes_to_send = m_write_idx;
+// 已解析出的指针指向旧缓冲区时平移到新缓冲区的相同位置
+static void rebase(char*& p, const char* old_buf, int len, char* new_buf) {
+    if (p && p >= old_buf && p < old_buf + len) {
+        p = new_buf + (p - old_buf);
+    }
+}
+
+// 读缓冲区大小翻倍(不超过m_max_request)，已读入的数据复制到新块
+// 请求行可能已经解析过，m_url等指针随之平移；头部只记录偏移，不需要调整
+bool http_conn::grow_read_buf() {
+    if (m_read_cap >= m_max_request) {
+        return false;
+    }
+    int want = m_read_cap * 2;
+    if (want > m_max_request) {
+        want = m_max_request;
+    }
+    int cap;
+    char* buf = buffer_pool::GetInstance()->alloc(want, &cap);
+    if (!buf) {
+        return false;
+    }
+    // 块可能比m_max_request大，只使用前m_max_request字节；归还时按大小向上取整，仍落在同一级
+    if (cap > m_max_request) {
+        cap = m_max_request;
+    }
+    memcpy(buf, m_read_buf, m_read_idx);
+    rebase(m_url, m_read_buf, m_read_cap, buf);
+    rebase(m_version, m_read_buf, m_read_cap, buf);
+    rebase(m_host, m_read_buf, m_read_cap, buf);
+    rebase(m_string, m_read_buf, m_read_cap, buf);
+    if (m_read_buf != m_read_inline) {
+        buffer_pool::GetInstance()->free(m_read_buf, m_read_cap);
+    }
+    m_read_buf = buf;
+    m_read_cap = cap;
     return true;
 }
 
+// 只在没有请求解析到一半时调用(新连接、关闭或一个应答完成后)，剩余数据放得进内联缓冲区时归还租用的块
+void http_conn::shrink_read_buf() {
+    if (m_read_buf == m_read_inline || m_read_idx >= READ_BUFFER_SIZE - 1) {
+        return;
+    }
+    memcpy(m_read_inline, m_read_buf, m_read_idx);
+    buffer_pool::GetInstance()->free(m_read_buf, m_read_cap);
+    m_read_buf = m_read_inline;
+    m_read_cap = READ_BUFFER_SIZE;
+}
+
+// 当前段放不下下一行时租用新的一段，之后的内容写到新段中
+bool http_conn::next_write_seg() {
+    if (m_write_seg_count == MAX_WRITE_SEGS) {
+        return false;
+    }
+    int cap;
+    char* seg = buffer_pool::GetInstance()->alloc(buffer_pool::MIN_BLOCK, &cap);
+    if (!seg) {
+        return false;
+    }
+    m_write_segs[m_write_seg_count++] = seg;
+    m_write_cur = seg;
+    m_write_cap = cap;
+    m_write_idx = 0;
+    return true;
+}
+
+void http_conn::release_write_segs() {
+    for (int i = 0; i < m_write_seg_count; ++i) {
+        buffer_pool::GetInstance()->free(m_write_segs[i], buffer_pool::MIN_BLOCK);
+    }
+    m_write_seg_count = 0;
+    m_write_cur = m_write_buf;
+    m_write_cap = WRITE_BUFFER_SIZE;
+    m_write_idx = 0;
+}
+
+// 重新监听读写事件：epoll后端重置EPOLLONESHOT，io_uring后端交给reactor线程提交recv/writev
+// 连接在这里交还给reactor线程：先清除m_busy，此后定时器可能立即回收连接对象，只能使用复制出来的字段
+void http_conn::rearm(int ev) {
+    int sockfd = m_sockfd;
+    int epollfd = m_epollfd;
+    uring_reactor* uring = m_uring;
+    unsigned int gen = m_gen;
+    m_busy.store(false, std::memory_order_release);
+    if (uring) {
+        uring->post(sockfd, gen, ev);
+    } else {
+        modfd(epollfd, sockfd, ev);
+    }
+}
+
 // 由线程池中的工作线程调用，处理HTTP请求
+// MODEL_PROACTOR下socket的读写都在reactor线程，这里只处理请求，应答生成后交回reactor线程发送；
+// MODEL_REACTOR下按任务先读socket或继续发送，应答生成后直接发送
+// 重新注册事件或转交给其他通道后连接可能立即被其他线程处理，之后不能再访问连接对象
 // process函数return后线程就变为空闲
 void http_conn::process() {
-    // 解析HTTP请求
-    HTTP_CODE read_ret = process_read();
+    // 本批应答的Date行取自当前线程的时钟
+    coarse_clock::update();
+    if (m_task == TASK_WRITE) {
+        send_responses();
+        return;
+    }
+    if (m_task == TASK_READ) {
+        m_task = TASK_PROCESS;
+        if (!read()) {
+            close_conn();
+            return;
+        }
+        // 读之前不知道请求属于哪个通道，登录、注册交给各自的线程池，保持通道之间的隔离
+        if (m_handoff && lane() != m_lane) {
+            HANDOFF ret = m_handoff(this);
+            if (ret == HANDOFF_QUEUED) {
+                return;
+            }
+            if (ret == HANDOFF_SHED) {
+                send_unavailable(m_sockfd);
+                close_conn();
+                return;
+            }
+        }
+    }
 
-    // 继续监听
-    if (read_ret == NO_REQUEST) {
-        modfd(m_epollfd, m_sockfd, EPOLLIN);
+    int responses = process_requests();
+    if (responses < 0) {
         return;
     }
+    // 继续监听
+    if (responses == 0) {
+        rearm(EPOLLIN);
+    } else if (m_io_model == MODEL_REACTOR && !m_uring) {
+        send_responses();
+    } else {
+        rearm(EPOLLOUT);
+    }
+}
+
+// 读缓冲区中可能有多个流水线请求，依次处理并把应答合并到一次writev中
+int http_conn::process_requests() {
+    int responses = 0;
+    m_more = false;
+    while (true) {
+        // 解析HTTP请求，数据不完整时等待更多数据
+        HTTP_CODE read_ret = process_read();
+        if (read_ret == NO_REQUEST) {
+            break;
+        }
+
+        // 生成响应
+        bool write_ret = process_write(read_ret);
+        if (!write_ret) {
+            close_conn();
+            return -1;
+        }
+        response_done();
+        ++responses;
+
+        // 不保持连接时后面的请求不再处理；缓冲区已空则等待
+        if (!m_keep_alive || m_read_idx == 0) {
+            break;
+        }
+        // 合并的应答达到上限，剩下的请求在这批应答发送完毕后处理
+        // 剩下的iovec和文件段要放得下一个最多范围的206应答
+        if (responses == MAX_PIPELINE ||
+            (m_write_cap - m_write_idx < RESPONSE_RESERVE && m_write_seg_count == MAX_WRITE_SEGS) ||
+            m_iv_count + 2 * MAX_RANGES + 3 > MAX_IOV || m_file_count + MAX_RANGES > MAX_FILES) {
+            m_more = true;
+            break;
+        }
+    }
+    return responses;
+}
 
-    // 生成响应
-    bool write_ret = process_write(read_ret);
-    if (!write_ret) {
-        close_conn();
+// write没发完时已重新注册EPOLLOUT，之后由reactor线程派发TASK_WRITE；
+// 发送完毕时已重新注册EPOLLIN，只有读缓冲区中还有完整请求时在本线程接着处理
+void http_conn::send_responses() {
+    while (true) {
+        WRITE_STATE state = write();
+        if (state == WRITE_CLOSE) {
+            close_conn();
+            return;
+        }
+        if (state != WRITE_PROCESS) {
+            return;
+        }
+        int responses = process_requests();
+        if (responses < 0) {
+            return;
+        }
+        if (responses == 0) {
+            rearm(EPOLLIN);
+            return;
+        }
     }
-    modfd(m_epollfd, m_sockfd, EPOLLOUT);
-}
\ No newline at end of file
+}
@@ -3,11 +3,16 @@
 
 #include <arpa/inet.h>
 #include <assert.h>
+#include <atomic>
+#include <charconv>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <map>
 #include <netinet/in.h>
 #include <pthread.h>
+#include <random>
+#include <set>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -15,19 +20,48 @@
 #include <string.h>
 #include <sys/epoll.h>
 #include <sys/mman.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <unistd.h>
+#include <vector>
+#include "buffer_pool.h"
+#include "coarse_clock.h"
+#include "compress.h"
+#include "config.h"
+#include "file_cache.h"
+#include "file_watcher.h"
+#include "http_header.h"
 #include "locker.h"
+#include "simd_scan.h"
 #include "sql_connection_pool.h"
 
+class uring_reactor;
+
 class http_conn {
    public:
     static const int FILENAME_LEN = 200;        // 文件名的最大长度
-    static const int READ_BUFFER_SIZE = 2048;   // 读缓冲区的大小
-    static const int WRITE_BUFFER_SIZE = 1024;  // 写缓冲区的大小
+    static const int READ_BUFFER_SIZE = 2048;   // 内联读缓冲区的大小，更长的请求从buffer_pool租用
+    static const int WRITE_BUFFER_SIZE = 1024;  // 内联写缓冲区的大小
+    static const int MAX_WRITE_SEGS = 4;        // 内联写缓冲区之后最多再租用的段数
+    static const int MAX_HEADERS = 64;          // 每个请求最多记录的头部个数
+    static const int MAX_PIPELINE = 8;          // 流水线请求一次最多合并发送的响应数
+    static const int RESPONSE_RESERVE = 256;    // 写缓冲区(含可租用的段)剩余不足该值时不再处理下一个流水线请求
+    static const int COMPRESS_MIN = 256;        // 小于该大小的文件不压缩
+    static const int MAX_RANGES = 8;            // 一个Range请求最多的范围数，超过时发送整个文件
+    static const int STREAM_WINDOW = 256 * 1024;  // mmap方式一次映射的文件窗口，大文件按窗口依次映射发送
+    // 待发送的iovec和文件段的上限：每个应答最多一个头部块、一个Date和Connection行块和一个文件块，头部跨段时多一个块；
+    // 多个范围的206应答每个范围多一个段头块和一个文件块
+    static const int MAX_IOV = 3 * MAX_PIPELINE + MAX_WRITE_SEGS + 2 * MAX_RANGES;
+    static const int MAX_FILES = MAX_PIPELINE + MAX_RANGES;
+
+    // Range中的一个范围
+    struct byte_range {
+        off_t start;
+        off_t len;
+    };
 
     // HTTP请求方法
     enum METHOD { GET = 0, POST, HEAD, PUT, DELETE, TRACE, OPTIONS, CONNECT };
@@ -52,6 +86,9 @@ class http_conn {
         NO_RESOURCE         :   表示服务器没有资源
         FORBIDDEN_REQUEST   :   表示客户对资源没有足够的访问权限
         FILE_REQUEST        :   文件请求,获取文件成功
+        NOT_MODIFIED        :   文件请求，客户端缓存的版本仍然有效，只回复304头部
+        PARTIAL_CONTENT     :   文件请求，只发送m_ranges中的范围(206)
+        RANGE_NOT_SATISFIABLE:  文件请求，Range中没有一个范围在文件内(416)
         INTERNAL_ERROR      :   表示服务器内部错误
         CLOSED_CONNECTION   :   表示客户端已经关闭连接了
     */
@@ -62,84 +99,233 @@ class http_conn {
         NO_RESOURCE,
         FORBIDDEN_REQUEST,
         FILE_REQUEST,
+        NOT_MODIFIED,
+        PARTIAL_CONTENT,
+        RANGE_NOT_SATISFIABLE,
         INTERNAL_ERROR,
         CLOSED_CONNECTION
     };
 
     // 从状态机的三种可能状态，即行的读取状态，分别表示 1.读取到一个完整的行 2.行出错 3.行数据尚且不完整
     enum LINE_STATUS { LINE_OK = 0, LINE_BAD, LINE_OPEN };
+    // 写操作之后连接的状态
+    // WRITE_CLOSE：出错或不保持连接；WRITE_AGAIN：还没发完，等待可写；
+    // WRITE_READ：发送完毕，等待下一个请求；WRITE_PROCESS：发送完毕，读缓冲区中还有完整的流水线请求待处理
+    // WRITE_YIELD：本轮发送量达到预算，已重新注册EPOLLOUT，排到其他就绪连接之后再继续
+    enum WRITE_STATE { WRITE_CLOSE = 0, WRITE_AGAIN, WRITE_READ, WRITE_PROCESS, WRITE_YIELD };
+    // 交给工作线程的任务：TASK_PROCESS为处理读缓冲区中的请求；
+    // MODEL_REACTOR下TASK_READ先读socket再处理，TASK_WRITE继续发送没发完的应答
+    enum TASK { TASK_PROCESS = 0, TASK_READ, TASK_WRITE };
+    // MODEL_REACTOR下工作线程读到的请求属于其他通道时的转交结果
+    // HANDOFF_QUEUED：已放进对应通道；HANDOFF_INLINE：由当前线程处理；HANDOFF_SHED：过载，回复503后关闭
+    enum HANDOFF { HANDOFF_QUEUED = 0, HANDOFF_INLINE, HANDOFF_SHED };
+    typedef HANDOFF (*handoff_fn)(http_conn* conn);
 
    public:
-    http_conn() {}
+    http_conn()
+        : m_read_buf(m_read_inline),
+          m_read_cap(READ_BUFFER_SIZE),
+          m_write_seg_count(0),
+          m_file_count(0),
+          m_file_fd(-1),
+          m_cached(NULL) {}
     ~http_conn() {}
 
    public:
-    void init(int sockfd, const sockaddr_in& addr);  // 初始化新接受的连接
-    void close_conn();                               // 关闭连接
-    void process();                                  // 处理客户端请求
+    // 初始化新接受的连接，uring非空时使用io_uring后端，否则注册到epollfd；gen为fd当前的代数
+    void init(int sockfd, const sockaddr_in& addr, int epollfd, uring_reactor* uring = NULL, unsigned int gen = 0);
+    void close_conn();                               // 关闭连接(由reactor线程完成)
+    void release_buffers();                          // 归还文件映射和租用的读写缓冲区，连接关闭后由reactor线程调用
+    void process();                                  // 工作线程的入口，按set_task设置的任务处理
+    // 放进线程池之前设置任务和所在通道，连接归工作线程所有，直到rearm把它交还给reactor线程
+    void set_task(int task, int lane) {
+        m_task = task;
+        m_lane = lane;
+        m_busy.store(true, std::memory_order_relaxed);
+    }
+    // 连接在工作线程手中(已交给线程池、还没有重新注册事件)，reactor线程不能回收连接对象和缓冲区
+    bool busy() const { return m_busy.load(std::memory_order_acquire); }
     bool read();                                     // 非阻塞读
-    bool write();                                    // 非阻塞写
-    void initmysql_result(connection_pool* connPool); // 初始化数据库读取表
+    WRITE_STATE write();                             // 非阻塞写
+    static void initmysql_result(connection_pool* connPool); // 初始化数据库读取表
+
+    // io_uring后端使用：数据由内核直接收到提供的缓冲区，再拷贝进读缓冲区
+    bool append_read(const char* buf, int len);
+    // 待发送的iovec，一次提交不超过写预算
+    struct iovec* write_iov(int* count);
+    bool advance_write(int bytes);  // 已发送bytes字节后调整iovec，返回是否全部发送完毕
+    WRITE_STATE finish_write();     // 响应发送完毕，返回WRITE_CLOSE、WRITE_READ或WRITE_PROCESS
+    // 根据读缓冲区中的请求行判断请求应交给哪个通道(LANE)，请求行不完整时按静态文件处理
+    int lane() const;
+
+    // 错误页和过载时的503应答在启动时完整生成一次；503由reactor线程直接发送后关闭连接
+    static void init_responses(int retry_after);
+    static void send_unavailable(int sockfd);
+    // 一个请求(请求行、头部和请求体)最多占用的读缓冲区字节数，超过时关闭连接
+    static void set_max_request(int bytes);
+    // 一个连接每轮最多发送的字节数，0为不限制；达到预算的次数
+    static void set_write_budget(int bytes) { m_write_budget = bytes; }
+    static unsigned long budget_hits() { return m_budget_hits.load(std::memory_order_relaxed); }
+    // 事件处理模式，IO_MODEL；handoff在MODEL_REACTOR下把请求转交给对应通道
+    static void set_io_model(int model, handoff_fn handoff) {
+        m_io_model = model;
+        m_handoff = handoff;
+    }
+    // 静态文件的发送方式，FILE_SEND_MODE；io_uring后端总是使用mmap
+    static void set_file_send(int mode);
+    // 静态文件缓存的容量(字节)，0为不缓存；preload时读入doc_root下的全部文件，返回读入的文件数
+    static int init_file_cache(size_t capacity, bool preload);
+    // 监听doc_root下的文件变化并使缓存失效，返回监听的目录数，失败返回-1
+    static int watch_files();
+    // 静态文件200或304应答的状态行和实体头部(不含Connection行)，返回长度；缓存的文件读入时生成一次
+    static int file_header(char* buf, int size, const char* path, const struct stat& st, bool not_modified);
+    // 压缩变体的头部，key为原文件路径加.gz或.br，作为变体缓存的header_builder
+    static int variant_header(char* buf, int size, const char* key, const struct stat& st, bool not_modified);
+    // 压缩变体缓存的容量(字节)，0为不压缩
+    static void init_compression(size_t capacity);
+    // 按URL路径前缀设置Cache-Control，启动时调用一次
+    static void set_cache_rules(const cache_rule* rules, int count);
 
    private:
     void init();                        // 初始化连接
+    void rearm(int ev);                 // 重新监听读(EPOLLIN)或写(EPOLLOUT)事件
     HTTP_CODE process_read();           // 解析HTTP请求
     bool process_write(HTTP_CODE ret);  // 填充HTTP应答
+    void response_done();               // 一个请求的应答已生成，把后续流水线请求移到读缓冲区开头
+    // 依次处理读缓冲区中的流水线请求，返回生成的应答数，出错关闭连接时返回-1
+    int process_requests();
+    // MODEL_REACTOR：工作线程直接发送，发送完毕后接着处理剩下的流水线请求
+    void send_responses();
+    // file为按窗口或sendfile发送的文件块对应的m_files下标
+    void push_iov(const char* base, size_t len, int file = -1);
+    // 从m_iv_idx起可以一次发送的iovec数：到sendfile的文件块之前，且包含的窗口之后没有待映射的部分
+    int gather_count() const;
+    // 截短从m_iv_idx起的count个iovec，使总长不超过budget，返回截短后的个数；unclip恢复被截短的iovec
+    int clip_iov(int count, long long budget);
+    void unclip();
+
+    // 读缓冲区满时换成更大的块；流水线请求处理完后剩余数据放得进内联缓冲区时换回来
+    bool grow_read_buf();
+    void shrink_read_buf();
+    // 当前写缓冲段满时租用下一段；应答发送完毕后归还
+    bool next_write_seg();
+    void release_write_segs();
 
     // process_read调用以分析HTTP请求相关函数
-    HTTP_CODE parse_request_line(char* text);
-    HTTP_CODE parse_headers(char* text);
+    HTTP_CODE parse_request_line(char* text, char* end);
+    HTTP_CODE parse_headers(char* text, char* end);
     HTTP_CODE parse_content(char* text);
     HTTP_CODE do_request();
+    // 请求的If-None-Match或If-Modified-Since表明客户端缓存的m_file_stat版本仍然有效
+    bool not_modified() const;
+    // 按Accept-Encoding换成压缩的变体，返回是否换了
+    bool use_variant();
+    // 按Range和If-Range决定发送整个文件还是部分范围
+    HTTP_CODE range_request();
     char* get_line() { return m_read_buf + m_start_line; }
+    // 已知头部的值(以\0结尾)，请求中没有该头部时返回NULL
+    const char* header(int id, int* len = NULL) const;
+    // 按名字(不区分大小写)查找任意头部
+    const char* header(const char* name, int* len = NULL) const;
     LINE_STATUS parse_line();
 
     // process_write调用以填充HTTP应答的相关函数
-    void unmap();
-    bool add_response(const char* format, ...);
-    bool add_content(const char* content);
-    bool add_content_type();
-    bool add_status_line(int status, const char* title);
-    bool add_headers(int content_length);
-    bool add_content_length(int content_length);
-    bool add_linger();
-    bool add_blank_line();
+    void release_files();
+    // 把文件从start开始的len字节加入发送队列，owner负责释放cached的引用或关闭fd
+    bool queue_file(cached_file* cached, int fd, off_t start, size_t len, bool owner);
+    bool add_partial();  // 206应答
+    bool add_unsatisfiable();  // 416应答
+    // 映射m_files[file]的下一个窗口，iv指向窗口中要发送的部分
+    bool map_window(int file, struct iovec* iv);
+    bool add_bytes(const char* data, int len);  // 复制进写缓冲区，不跨段
+    bool add_connection();                      // 追加Date行、Connection行和空行
 
    public:
-    static int m_epollfd;  // 所有socket上的事件都被注册到同一个epoll内核事件中，所以设置成静态的
-    static int m_user_count;  // 统计用户的数量
-    MYSQL* mysql;  // 数据库连接
+    static std::atomic<int> m_user_count;  // 统计用户的数量，多个reactor线程和工作线程都会修改
+    static int m_max_request;              // 一个请求最多占用的读缓冲区字节数
+    static int m_write_budget;             // 一个连接每轮最多发送的字节数，0为不限制
+    static int m_io_model;                 // IO_MODEL
+    static handoff_fn m_handoff;
+    static std::atomic<unsigned long> m_budget_hits;
+    static int m_file_send;                // 静态文件的发送方式
 
    private:
+    // 热数据：每个请求的解析和发送都会访问，集中在对象开头，解析状态在前两个缓存行内
     int m_sockfd;  // 该HTTP连接的socket(cfd)
-    sockaddr_in m_address;   // 对方的socket地址
+    int m_epollfd;  // 接受该连接的reactor所拥有的epoll
+    uring_reactor* m_uring;  // 接受该连接的io_uring reactor，epoll后端时为NULL
+    unsigned int m_gen;      // 接受时fd的代数，随post一起交给reactor线程，用来识别fd已被复用的迟到请求
 
-    char m_read_buf[READ_BUFFER_SIZE];  // 读缓冲区
+    char* m_read_buf;   // 读缓冲区，指向m_read_inline或从buffer_pool租用的块
+    int m_read_cap;     // 读缓冲区的大小，最后一个字节总是留给请求体后的\0
     int m_read_idx;     // 标识读缓冲区中已经读入的客户端数据的最后一个字节的下一个位置
     int m_checked_idx;  // 当前正在分析的字符在读缓冲区中的位置
     int m_start_line;   // 当前正在解析的行的起始位置
 
     CHECK_STATE m_check_state;  // 主状态机当前所处的状态
     METHOD m_method;            // 请求方法
-
-    char m_real_file[FILENAME_LEN];  // 客户请求的目标文件的完整路径，根目录+m_url
+    int m_content_length;  // HTTP请求的消息总长度
+    bool m_linger;         // HTTP请求是否要求保持连接
+    bool m_keep_alive;     // 最后一个已生成应答的请求是否要求保持连接
+    bool m_more;           // 应答已合并到上限，读缓冲区中还有没处理的完整请求
+    int m_task;            // 交给工作线程的任务，TASK
+    int m_lane;            // 任务所在的通道，LANE
+    std::atomic<bool> m_busy;  // set_task之后、rearm之前为true
+    char m_body_end;       // 请求体后一个字节被改为\0之前的值，移动后续请求前恢复
+    int m_header_count;          // m_headers中的头部个数
+    unsigned int m_known_mask;   // m_known中有效的项
     char* m_url;           // 客户请求的目标文件的文件名
     char* m_version;       // HTTP协议版本号
     char* m_host;          // 主机名
-    int m_content_length;  // HTTP请求的消息总长度
-    bool m_linger;         // HTTP请求是否要求保持连接
+    char* m_string;        // 存储请求头数据
 
-    char m_write_buf[WRITE_BUFFER_SIZE];  // 写缓冲区
-    int m_write_idx;        // 写缓冲区中待发送的字节数
-    char* m_file_address;   // 客户请求的目标文件被mmap到内存中的起始位置
-    struct stat m_file_stat;  // 目标文件的状态，判断文件是否存在、是否为目录、是否可读，并获取文件大小等信息
-    struct iovec m_iv[2];  // 采用writev来执行写操作，其中m_iv_count表示被写内存块的数量。
+    char* m_write_cur;      // 当前正在写入的段
+    int m_write_cap;        // 当前段的大小
+    int m_write_idx;        // 当前段中已写入的字节数
+    int m_write_seg_count;  // m_write_segs中的段数
     int m_iv_count;
+    int m_iv_idx;
+    int m_clip_idx;        // 为了不超过写预算被截短的iovec
+    size_t m_clip_len;     // 截掉的长度，0表示没有截短
+    int m_file_count;     // m_files中的文件段数
+    long long bytes_to_send;    // 将要发送的数据的字节数
+    long long bytes_have_send;  // 已经发送的字节数
+    int m_file_fd;          // 客户请求的目标文件(没有缓存时)，还没有加入发送队列
+    cached_file* m_cached;  // 客户请求的目标文件在缓存中的条目，还没有加入发送队列
+    int m_encoding;         // 发送的内容编码，CONTENT_ENCODING
+
+    // 冷数据：只在用到的部分被访问，新连接和新请求都不清零
+    sockaddr_in m_address;   // 对方的socket地址
+    header_view m_known[H_NUM];  // 已知头部按HEADER_ID索引，同名头部只记录第一个
+    header_view m_headers[MAX_HEADERS];  // 请求中的全部头部，按出现顺序
+    byte_range m_ranges[MAX_RANGES];     // PARTIAL_CONTENT时要发送的范围
+    int m_range_count;
+
+    // 多个流水线请求的应答头部和文件依次排列，m_iv_idx为第一个未发完的块
+    // 缓存的文件头部、Connection行和错误页直接指向预先生成的内容；sendfile方式的文件块iov_base为NULL，
+    // mmap方式的文件块指向当前窗口，发完一个窗口后换成下一个
+    struct iovec m_iv[MAX_IOV];
+    short m_iv_file[MAX_IOV];  // 文件块对应的m_files下标，其他块为-1
+    // 已排队发送的文件段，发送完毕后统一释放；多个范围的同一个文件只有第一段是owner
+    // 缓存的文件直接指向内存，sendfile方式记录下一次发送的偏移，mmap方式记录当前映射的窗口和下一个窗口的位置
+    struct queued_file {
+        cached_file* cached;
+        int fd;
+        bool owner;
+        char* map;
+        size_t map_len;
+        off_t offset;
+        size_t rest;  // mmap方式当前窗口之后还没映射的字节数
+    };
+    queued_file m_files[MAX_FILES];
+    char* m_write_segs[MAX_WRITE_SEGS];   // 内联写缓冲区写满后租用的后续段，每段buffer_pool::MIN_BLOCK字节
 
-    int bytes_to_send;    // 将要发送的数据的字节数
-    int bytes_have_send;  // 已经发送的字节数
+    char m_real_file[FILENAME_LEN];  // 客户请求的目标文件的完整路径，根目录+m_url
+    struct stat m_file_stat;  // 目标文件的状态，判断文件是否存在、是否为目录、是否可读，并获取文件大小等信息
 
-    char* m_string;  // 存储请求头数据
+    // 写缓冲区由内联的第一段和按需租用的后续段组成，每段的内容直接作为iovec发送
+    char m_write_buf[WRITE_BUFFER_SIZE];   // 内联的第一段
+    char m_read_inline[READ_BUFFER_SIZE];  // 内联的读缓冲区，空闲连接只占用这一部分
 };
 
 #endif
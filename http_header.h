@@ -0,0 +1,129 @@
+#ifndef HTTP_HEADER_H
+#define HTTP_HEADER_H
+
+#include <strings.h>
+
+// 已知的请求头部
+// 名字到编号的映射是编译期生成的完美哈希：取(长度, 首字符, 末字符)算哈希，
+// 编译期搜索一个使所有已知头部互不冲突的种子，运行时一次哈希加一次strncasecmp确认
+enum HEADER_ID {
+    H_UNKNOWN = -1,
+    H_CONNECTION = 0,
+    H_CONTENT_LENGTH,
+    H_CONTENT_TYPE,
+    H_HOST,
+    H_USER_AGENT,
+    H_ACCEPT,
+    H_ACCEPT_ENCODING,
+    H_CACHE_CONTROL,
+    H_COOKIE,
+    H_REFERER,
+    H_IF_NONE_MATCH,
+    H_IF_MODIFIED_SINCE,
+    H_RANGE,
+    H_IF_RANGE,
+    H_TRANSFER_ENCODING,
+    H_EXPECT,
+    H_NUM
+};
+
+// http_conn用一个32位掩码记录出现过的已知头部
+static_assert(H_NUM <= 32, "too many known headers");
+
+// 请求头部在读缓冲区中的位置，只记录偏移和长度，不复制
+struct header_view {
+    int name_off;
+    int name_len;
+    int value_off;
+    int value_len;
+};
+
+namespace header_hash {
+
+struct name_entry {
+    const char* name;
+    int len;
+};
+
+// 与HEADER_ID的顺序一致
+constexpr name_entry names[H_NUM] = {
+    {"Connection", 10},      {"Content-Length", 14},    {"Content-Type", 12},
+    {"Host", 4},             {"User-Agent", 10},        {"Accept", 6},
+    {"Accept-Encoding", 15}, {"Cache-Control", 13},     {"Cookie", 6},
+    {"Referer", 7},          {"If-None-Match", 13},     {"If-Modified-Since", 17},
+    {"Range", 5},            {"If-Range", 8},           {"Transfer-Encoding", 17},
+    {"Expect", 6},
+};
+
+constexpr int TABLE_BITS = 6;
+constexpr int TABLE_SIZE = 1 << TABLE_BITS;
+
+constexpr unsigned int lower(char c) {
+    return (c >= 'A' && c <= 'Z') ? (unsigned int)(c - 'A' + 'a') : (unsigned int)(unsigned char)c;
+}
+
+constexpr unsigned int hash(const char* name, int len, unsigned int seed) {
+    unsigned int h = seed;
+    h = (h ^ (unsigned int)len) * 16777619u;
+    h = (h ^ lower(name[0])) * 16777619u;
+    h = (h ^ lower(name[len - 1])) * 16777619u;
+    return h >> (32 - TABLE_BITS);
+}
+
+constexpr bool collision_free(unsigned int seed) {
+    bool used[TABLE_SIZE] = {};
+    for (int i = 0; i < H_NUM; ++i) {
+        unsigned int slot = hash(names[i].name, names[i].len, seed);
+        if (used[slot]) {
+            return false;
+        }
+        used[slot] = true;
+    }
+    return true;
+}
+
+constexpr unsigned int find_seed() {
+    unsigned int seed = 2166136261u;
+    while (!collision_free(seed)) {
+        ++seed;
+    }
+    return seed;
+}
+
+constexpr unsigned int SEED = find_seed();
+static_assert(collision_free(SEED), "header names must hash to distinct slots");
+
+// 槽 -> 头部编号，空槽为H_UNKNOWN
+struct slot_table {
+    signed char id[TABLE_SIZE];
+};
+
+constexpr slot_table make_table() {
+    slot_table t = {};
+    for (int i = 0; i < TABLE_SIZE; ++i) {
+        t.id[i] = H_UNKNOWN;
+    }
+    for (int i = 0; i < H_NUM; ++i) {
+        t.id[hash(names[i].name, names[i].len, SEED)] = (signed char)i;
+    }
+    return t;
+}
+
+constexpr slot_table table = make_table();
+
+}  // namespace header_hash
+
+// 头部名字(不区分大小写)对应的编号，不是已知头部时返回H_UNKNOWN
+inline int header_id(const char* name, int len) {
+    if (len <= 0) {
+        return H_UNKNOWN;
+    }
+    int id = header_hash::table.id[header_hash::hash(name, len, header_hash::SEED)];
+    if (id == H_UNKNOWN || header_hash::names[id].len != len ||
+        strncasecmp(name, header_hash::names[id].name, len) != 0) {
+        return H_UNKNOWN;
+    }
+    return id;
+}
+
+#endif
@@ -1,11 +1,16 @@
 #ifndef LOCKER_H
 #define LOCKER_H
 
+#include <linux/futex.h>
 #include <pthread.h>
 #include <semaphore.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <atomic>
 #include <exception>
 
-// 互斥锁、条件变量、信号量
+// 互斥锁、条件变量、信号量、事件计数
 
 // 互斥锁类
 class locker {
@@ -78,4 +83,42 @@ class sem {
     sem_t m_sem;
 };
 
-#endif
\ No newline at end of file
+// 事件计数(eventcount)，无锁队列的消费者没有任务时在futex上休眠
+// 用法：消费者取任务失败后prepare_wait()，再取一次，仍然失败才wait(key)，成功则cancel_wait()；
+// 生产者放入任务后notify()，没有等待者时不进入内核
+class eventcount {
+   public:
+    eventcount() : m_epoch(0), m_waiters(0) {}
+
+    uint32_t prepare_wait() {
+        m_waiters.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return m_epoch.load(std::memory_order_seq_cst);
+    }
+    void cancel_wait() { m_waiters.fetch_sub(1, std::memory_order_relaxed); }
+    // 是否有消费者已经登记等待，生产者据此决定唤醒哪一个消费者
+    bool waiting() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return m_waiters.load(std::memory_order_relaxed) > 0;
+    }
+    // 自prepare_wait以来没有notify时休眠
+    void wait(uint32_t key) {
+        syscall(SYS_futex, (uint32_t*)&m_epoch, FUTEX_WAIT_PRIVATE, key, NULL, NULL, 0);
+        m_waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+    void notify(int count = 1) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_waiters.load(std::memory_order_relaxed) == 0) {
+            return;
+        }
+        m_epoch.fetch_add(1, std::memory_order_seq_cst);
+        syscall(SYS_futex, (uint32_t*)&m_epoch, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+    }
+    void notify_all() { notify(INT32_MAX); }
+
+   private:
+    std::atomic<uint32_t> m_epoch;
+    std::atomic<int> m_waiters;
+};
+
+#endif
@@ -2,40 +2,91 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <netinet/in.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/epoll.h>
+#include <sys/signalfd.h>
 #include <sys/socket.h>
+#include <sys/timerfd.h>
 #include <unistd.h>
+#include <atomic>
+#include "affinity.h"
+#include "buffer_pool.h"
+#include "coarse_clock.h"
+#include "config.h"
+#include "conn_slab.h"
+#include "file_cache.h"
 #include "noa_timer.h"
 #include "http_conn.h"
 #include "locker.h"
 #include "sql_connection_pool.h"
 #include "threadpool.h"
+#include "uring.h"
 
 #define MAX_FD 65536            // 最大的文件描述符个数
 #define MAX_EVENT_NUMBER 10000  // 监听的最大的事件数量
-#define TIMESLOT 5              // 超时时间 
+#define TIMESLOT 5              // 超时时间(秒)，非活跃连接在若干个TIMESLOT后被关闭
+#define URING_ENTRIES 4096      // io_uring提交队列长度
+#define URING_BUF_NUM 1024      // 每个io_uring reactor提供给内核的接收缓冲区个数
 
 // http_conn中定义
 extern void addfd(int epollfd, int fd, bool one_shot);
 extern void removefd(int epollfd, int fd);
 extern int setnonblocking(int fd);
 
-// 设置定时器相关参数
-static int pipefd[2];
-static sort_timer_lst timer_lst;
-static int epollfd = 0;
-
-// 信号处理函数，仅发送信号值给主循环，不做对应逻辑处理
-void sig_handler(int sig) {
-    int save_errno = errno;
-    int msg = sig;
-    // 将信号值从管道写端写入
-    send(pipefd[1], (char*)&msg, 1, 0);
-    errno = save_errno;
-}
+// slab中的一个连接：定时器和客户信息与连接对象一起在accept时分配，关闭时放回
+struct conn_slot {
+    client_timer timer;
+    http_conn conn;
+};
+
+// 每个reactor线程独占的资源：epoll、SO_REUSEPORT监听socket、timerfd、时间轮和连接对象的slab
+// users/slots以文件描述符为下标，fd在进程内唯一，
+// 所以每个reactor只会访问自己accept到的那部分元素
+struct reactor {
+    int id;
+    int cpu;  // 绑定的CPU，与同序号的工作线程相同
+    pthread_t thread;
+    int epollfd;
+    int listenfd;
+    int timerfd;  // 每tick_ms毫秒可读一次，驱动时间轮
+    int sigfd;    // SIGTERM/SIGHUP，只有0号reactor持有，其余为-1
+    time_wheel timer_lst;
+    uring_reactor* uring;  // io_uring后端时非空
+    conn_slab<conn_slot> conns;  // accept时分配连接对象和定时器，关闭时放回
+    bool accepting;       // 是否在accept，过载时暂停
+    bool accept_armed;    // io_uring后端：多次触发的accept是否仍在内核中
+    uint64_t ticks;                   // io_uring后端读取timerfd的缓冲区
+    struct signalfd_siginfo siginfo;  // io_uring后端读取signalfd的缓冲区
+};
+
+static reactor* reactors = NULL;
+static int reactor_num = 0;
+// 连接按需从accept它的reactor的slab中分配，没有连接的fd为NULL；users指向slots[fd]->conn
+static http_conn** users = NULL;
+static conn_slot** slots = NULL;
+// 每个通道一个线程池(舱壁)，各自的线程数、队列上限和过载处理方式
+struct lane {
+    threadpool<http_conn>* pool;
+    int policy;
+    std::atomic<unsigned long> overflow;  // 队列已满而被拒绝或由reactor直接处理的请求数
+    std::atomic<unsigned long> shed;      // 回复503的请求数
+};
+static lane lanes[LANE_NUM];
+// 事件处理模式，IO_MODEL
+static int io_model = MODEL_PROACTOR;
+// 过载保护的阈值，见config
+static int max_conn = MAX_FD;
+static unsigned long max_wait_us = 0;
+// 因连接数已满在accept时回复503的连接数，以及暂停accept的次数
+static std::atomic<unsigned long> shed_accept(0);
+static std::atomic<unsigned long> accept_pauses(0);
+// 每个fd上连接的代数，连接关闭时递增，io_uring后端据此丢弃已关闭连接的迟到完成事件
+static unsigned int* conn_gen = NULL;
+// 收到SIGTERM后由0号reactor置位，其余reactor在下一次tick时退出
+static std::atomic<bool> stop_server(false);
 
 // 为信号设置处理函数
 void addsig(int sig, void(handler)(int)) {
@@ -46,56 +97,52 @@ void addsig(int sig, void(handler)(int)) {
     assert(sigaction(sig, &sa, NULL) != -1);
 }
 
-// 调用任务处理函数tick()处理链表中的定时器，接着重新定时以不断触发SIGALRM信号
-void timer_handler() {
-    timer_lst.tick();
-    alarm(TIMESLOT);
-}
-
 // 定时器回调函数，删除非活跃连接在socket上的注册事件，并关闭
 void cb_func(client_timer *user_data) {
-    epoll_ctl(epollfd, EPOLL_CTL_DEL, user_data->sockfd, 0);
     assert(user_data);
-    close(user_data->sockfd);
+    if (user_data->epollfd != -1) {
+        epoll_ctl(user_data->epollfd, EPOLL_CTL_DEL, user_data->sockfd, 0);
+    } else {
+        // io_uring后端：未完成的recv持有socket的引用，先shutdown使其立即返回
+        shutdown(user_data->sockfd, SHUT_RDWR);
+    }
+    int sockfd = user_data->sockfd;
+    conn_gen[sockfd]++;
+    // 连接放回slab，必须在close之前：close后fd可能立即被其他reactor accept
+    // user_data就在slot中，放回后不能再访问
+    conn_slot* slot = slots[sockfd];
+    slot->conn.release_buffers();
+    users[sockfd] = NULL;
+    slots[sockfd] = NULL;
+    reactors[user_data->reactor].conns.free(slot);
+    close(sockfd);
     http_conn::m_user_count--;
     // info
     // printf("A nonactive connection closed.\n");
 }
 
-int main(int argc, char* argv[]) {
-    if (argc <= 1) {
-        printf("usage: %s port_number\n", basename(argv[0]));
-        return 1;
+// 定时器到期时由时间轮调用
+// 连接还在工作线程手中(如排队超过超时时间的数据库请求)时不能回收连接对象和缓冲区，
+// 推迟一个TIMESLOT再检查，工作线程重新注册事件后才由cb_func关闭
+void expire_func(client_timer *user_data) {
+    if (users[user_data->sockfd]->busy()) {
+        util_timer* timer = &user_data->timer;
+        timer->expire = coarse_clock::now_ms() + TIMESLOT * 1000;
+        reactors[user_data->reactor].timer_lst.add_timer(timer);
+        return;
     }
+    cb_func(user_data);
+}
 
-    int port = atoi(argv[1]);
-
-    // 注册信号捕捉，因为一端断开后另一端还继续写数据会产生SIGPIPE信号，默认会终止进程，这里选择忽略
-    addsig(SIGPIPE, SIG_IGN);
-
-    // 数据库连接池
-    connection_pool *connPool = connection_pool::GetInstance();
-    connPool->init("localhost", "rjgc", "rjgc123", "WebServerDB", 3306, 8);
-
-    // 线程池
-    threadpool<http_conn>* pool = NULL;
-    try {
-        pool = new threadpool<http_conn>(connPool);
-    } catch (...) {
-        return 1;
-    }
-    printf("Thread pool created.\n");
-
-    // 保存客户端信息
-    http_conn* users = new http_conn[MAX_FD];
-    // 初始化数据库读取表
-    users->initmysql_result(connPool);
-
-    // lfd
+// 创建绑定到同一端口的监听socket，由内核在各个SO_REUSEPORT socket之间分发新连接
+int create_listenfd(int port) {
     int listenfd = socket(PF_INET, SOCK_STREAM, 0);
+    if (listenfd < 0) {
+        return -1;
+    }
 
-    int ret = 0;
     struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
     address.sin_addr.s_addr = INADDR_ANY;
     address.sin_family = AF_INET;
     address.sin_port = htons(port);
@@ -103,180 +150,690 @@ int main(int argc, char* argv[]) {
     // 端口复用
     int reuse = 1;
     setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse));
 
     // 绑定监听
-    ret = bind(listenfd, (struct sockaddr*)&address, sizeof(address));
-    ret = listen(listenfd, 5);
+    if (bind(listenfd, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(listenfd, 5) < 0) {
+        close(listenfd);
+        return -1;
+    }
+    return listenfd;
+}
+
+// 创建周期为tick_ms毫秒的timerfd
+// 不设置非阻塞：io_uring对非阻塞fd的读直接返回EAGAIN，epoll后端在addfd中再设置非阻塞
+int create_timerfd(int tick_ms) {
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    struct itimerspec its;
+    its.it_value.tv_sec = tick_ms / 1000;
+    its.it_value.tv_nsec = (tick_ms % 1000) * 1000000L;
+    its.it_interval = its.it_value;
+    if (timerfd_settime(fd, 0, &its, NULL) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// 需要由signalfd接收的信号，main在创建任何线程之前屏蔽它们
+void signal_mask(sigset_t* mask) {
+    sigemptyset(mask);
+    sigaddset(mask, SIGTERM);
+    sigaddset(mask, SIGHUP);
+}
+
+// 初始化reactor：创建监听socket、epoll(或io_uring)、timerfd，0号reactor还持有signalfd
+bool reactor_init(reactor* r, int id, const config& conf) {
+    r->id = id;
+    r->cpu = cpu_for(id);
+    r->uring = NULL;
+    r->sigfd = -1;
+    r->accepting = true;
+    r->accept_armed = false;
+    r->timer_lst.init(conf.tick_ms);
+    r->listenfd = create_listenfd(conf.port);
+    if (r->listenfd < 0) {
+        return false;
+    }
+
+    // 定时器相关
+    r->timerfd = create_timerfd(conf.tick_ms);
+    if (r->timerfd < 0) {
+        return false;
+    }
+    // 信号是发给进程的，由一个signalfd接收即可
+    if (id == 0) {
+        sigset_t mask;
+        signal_mask(&mask);
+        r->sigfd = signalfd(-1, &mask, SFD_CLOEXEC);
+        if (r->sigfd < 0) {
+            return false;
+        }
+    }
+
+    if (conf.io_backend == IO_URING) {
+        r->epollfd = -1;
+        r->uring = new uring_reactor;
+        return r->uring->init(URING_ENTRIES, URING_BUF_NUM, http_conn::READ_BUFFER_SIZE);
+    }
 
     // 创建epoll对象
-    int epollfd = epoll_create(5);
-    // 创建监听的事件数组
-    epoll_event events[MAX_EVENT_NUMBER];
-    
+    r->epollfd = epoll_create(5);
+    if (r->epollfd < 0) {
+        return false;
+    }
     // 将要监听事件的文件描述符添加到epoll对象中
-    addfd(epollfd, listenfd, false);
-    http_conn::m_epollfd = epollfd;
+    addfd(r->epollfd, r->listenfd, false);
+    addfd(r->epollfd, r->timerfd, false);
+    if (r->sigfd != -1) {
+        addfd(r->epollfd, r->sigfd, false);
+    }
+    return true;
+}
 
-    // 定时器相关
-    // 创建管道
-    ret = socketpair(PF_UNIX, SOCK_STREAM, 0, pipefd);
-    assert(ret != -1);
-    setnonblocking(pipefd[1]);
-    addfd(epollfd, pipefd[0], false);
-    //传递给主循环的信号值，这里只关注SIGALRM和SIGTERM
-    addsig(SIGALRM, sig_handler);
-    addsig(SIGTERM, sig_handler);
-    bool stop_server = false;
-    // 
-    client_timer* users_timer = new client_timer[MAX_FD];
+// 初始化新连接的客户信息，创建定时器并添加到本reactor的时间轮中，连接对象分配失败时返回false
+bool add_conn(reactor* r, int connfd, const sockaddr_in& client_address) {
+    // 从本reactor的slab中取一个连接对象，初始化客户信息
+    conn_slot* slot = r->conns.alloc();
+    if (!slot) {
+        return false;
+    }
+    slots[connfd] = slot;
+    users[connfd] = &slot->conn;
+    slot->conn.init(connfd, client_address, r->epollfd, r->uring, conn_gen[connfd]);
+
+    // 初始化client_timer数据
+    // 定时器嵌在client_timer中，设置回调函数和超时时间，绑定用户数据，添加到本reactor的时间轮中，不申请内存
+    client_timer* ct = &slot->timer;
+    ct->address = client_address;
+    ct->sockfd = connfd;
+    ct->epollfd = r->epollfd;
+    ct->reactor = r->id;
+    util_timer* timer = &ct->timer;
+    timer->user_data = ct;
+    // 回调函数
+    timer->cb_func = expire_func;
+    time_t cur = coarse_clock::now_ms();
+    // 设置超时时间为5倍TIMESLOT
+    timer->expire = cur + 5 * TIMESLOT * 1000;
+    r->timer_lst.add_timer(timer);
+    return true;
+}
+
+// 连接有读写活动，延长定时器
+void refresh_timer(reactor* r, int sockfd, int timeslots) {
+    util_timer* timer = &slots[sockfd]->timer.timer;
+    // 更新定时器在时间轮中的槽
+    if (timer->active()) {
+        time_t cur = coarse_clock::now_ms();
+        timer->expire = cur + timeslots * TIMESLOT * 1000;
+        r->timer_lst.adjust_timer(timer);
+    }
+}
+
+// 关闭连接并移除对应的定时器，slot已放回说明连接已经关闭
+void close_timer(reactor* r, int sockfd) {
+    conn_slot* slot = slots[sockfd];
+    if (!slot) {
+        return;
+    }
+    r->timer_lst.del_timer(&slot->timer.timer);
+    cb_func(&slot->timer);
+    // users[sockfd].close_conn();
+}
+
+// 处理signalfd读到的信号：SIGTERM退出，SIGHUP打印运行状态
+void handle_signal(const struct signalfd_siginfo& si) {
+    switch (si.ssi_signo) {
+        // 进程被杀死
+        case SIGTERM: {
+            stop_server = true;
+            // info
+            // printf("SIGTERM reached!\n");
+            break;
+        }
+        case SIGHUP: {
+            printf("connections: %d, refused at accept %lu, accept paused %lu times, write budget hit %lu times\n",
+                   (int)http_conn::m_user_count, shed_accept.load(), accept_pauses.load(), http_conn::budget_hits());
+            size_t slab_used = 0, slab_cap = 0;
+            for (int i = 0; i < reactor_num; ++i) {
+                slab_used += reactors[i].conns.in_use();
+                slab_cap += reactors[i].conns.capacity();
+            }
+            printf("connection slabs: %zu in use of %zu (%zu bytes each), buffers: leased %ld KB, cached %ld KB\n",
+                   slab_used, slab_cap, sizeof(conn_slot), buffer_pool::GetInstance()->leased() >> 10,
+                   buffer_pool::GetInstance()->cached() >> 10);
+            file_cache* cache = file_cache::GetInstance();
+            printf("file cache: %zu files, %zu KB, hits %lu, misses %lu, evictions %lu, invalidations %lu\n",
+                   cache->files(), cache->bytes() >> 10, cache->hits(), cache->misses(), cache->evictions(),
+                   cache->invalidations());
+            file_cache* variants = file_cache::GetVariants();
+            printf("compressed variants: %zu files, %zu KB, hits %lu, misses %lu, evictions %lu, invalidations %lu\n",
+                   variants->files(), variants->bytes() >> 10, variants->hits(), variants->misses(),
+                   variants->evictions(), variants->invalidations());
+            for (int i = 0; i < LANE_NUM; ++i) {
+                threadpool_stats st;
+                lanes[i].pool->stats(&st);
+                unsigned long done = st.completed();
+                printf("lane %-6s: queued %d, done %lu (local %lu, stolen %lu), overflow %lu, shed %lu, "
+                       "wait avg %luus p50 %luus p99 %luus max %luus\n",
+                       config::lane_name(i), st.pending, done, st.local_hits, st.steals,
+                       lanes[i].overflow.load(), lanes[i].shed.load(), done ? st.wait_total_us / done : 0,
+                       st.wait_percentile(0.5), st.wait_percentile(0.99), st.wait_max_us);
+            }
+            fflush(stdout);
+            break;
+        }
+    }
+}
+
+// 通道队列中等待最久的请求已经排队超过了max_wait_us
+bool lane_overloaded(lane* l) {
+    return max_wait_us && l->pool->pending() > 0 && l->pool->oldest_wait_us() > max_wait_us;
+}
+
+// 连接数达到上限，或静态文件通道过载时，整个服务器视为饱和
+bool saturated() {
+    return http_conn::m_user_count >= max_conn || lane_overloaded(&lanes[LANE_STATIC]);
+}
+
+// 回复503并关闭连接
+void shed(reactor* r, lane* l, int sockfd) {
+    l->shed.fetch_add(1, std::memory_order_relaxed);
+    http_conn::send_unavailable(sockfd);
+    close_timer(r, sockfd);
+}
+
+// 把连接交给对应通道的线程池，过载时回复503，队列已满时按通道的过载策略处理
+// task为TASK_PROCESS时读缓冲区中已有完整数据；MODEL_REACTOR下为TASK_READ/TASK_WRITE，由工作线程读写socket
+void dispatch(reactor* r, int sockfd, int task = http_conn::TASK_PROCESS) {
+    int idx = users[sockfd]->lane();
+    lane* l = &lanes[idx];
+    // 发送到一半的应答不能再回复503，队列满时由reactor线程直接发送
+    if (task != http_conn::TASK_WRITE && lane_overloaded(l)) {
+        shed(r, l, sockfd);
+        return;
+    }
+    users[sockfd]->set_task(task, idx);
+    if (l->pool->append(users[sockfd], r->cpu)) {
+        return;
+    }
+    l->overflow.fetch_add(1, std::memory_order_relaxed);
+    if (l->policy == OVERLOAD_INLINE || task == http_conn::TASK_WRITE) {
+        users[sockfd]->process();
+    } else {
+        shed(r, l, sockfd);
+    }
+}
+
+// MODEL_REACTOR下工作线程读到的请求属于其他通道时调用，过载判断与dispatch相同
+// 运行在工作线程中，不能操作定时器，503由调用者发送后经close_conn交给reactor线程关闭
+http_conn::HANDOFF handoff(http_conn* conn) {
+    int idx = conn->lane();
+    lane* l = &lanes[idx];
+    if (lane_overloaded(l)) {
+        l->shed.fetch_add(1, std::memory_order_relaxed);
+        return http_conn::HANDOFF_SHED;
+    }
+    conn->set_task(http_conn::TASK_PROCESS, idx);
+    if (l->pool->append(conn)) {
+        return http_conn::HANDOFF_QUEUED;
+    }
+    l->overflow.fetch_add(1, std::memory_order_relaxed);
+    if (l->policy == OVERLOAD_INLINE) {
+        return http_conn::HANDOFF_INLINE;
+    }
+    l->shed.fetch_add(1, std::memory_order_relaxed);
+    return http_conn::HANDOFF_SHED;
+}
+
+// 饱和时暂停accept，新连接留在内核的监听队列中，恢复后再取出；每批事件处理完后检查一次
+void update_accept(reactor* r) {
+    bool sat = saturated();
+    if (sat && r->accepting) {
+        r->accepting = false;
+        accept_pauses.fetch_add(1, std::memory_order_relaxed);
+        if (r->uring) {
+            if (r->accept_armed) {
+                r->uring->prep_cancel_accept(r->listenfd);
+            }
+        } else {
+            epoll_ctl(r->epollfd, EPOLL_CTL_DEL, r->listenfd, 0);
+        }
+    } else if (!sat && !r->accepting) {
+        r->accepting = true;
+        if (r->uring) {
+            // 被取消的accept还没有完成时，由它的完成事件重新提交
+            if (!r->accept_armed) {
+                r->uring->prep_accept(r->listenfd);
+                r->accept_armed = true;
+            }
+        } else {
+            addfd(r->epollfd, r->listenfd, false);
+        }
+    }
+}
+
+// 新连接到来时连接数已满，回复503后关闭
+void refuse_conn(int connfd) {
+    shed_accept.fetch_add(1, std::memory_order_relaxed);
+    http_conn::send_unavailable(connfd);
+    close(connfd);
+}
+
+// reactor线程的事件循环，负责本线程上连接的accept、read、write和超时处理
+void* eventloop(void* arg) {
+    reactor* r = (reactor*)arg;
+    pin_thread(r->cpu);
+    // 创建监听的事件数组
+    epoll_event* events = new epoll_event[MAX_EVENT_NUMBER];
     // 是否超时
     bool timeout = false;
-    // 每隔TIMESLOT时间触发SIGALRM信号
-    alarm(TIMESLOT);
-
 
     while (!stop_server) {
-        int number = epoll_wait(epollfd, events, MAX_EVENT_NUMBER, -1);
-        // 因为是阻塞的，有可能因为信号捕捉后不阻塞返回-1，产生EINTR
+        int number = epoll_wait(r->epollfd, events, MAX_EVENT_NUMBER, -1);
+        // 信号由signalfd接收，epoll_wait不会再被信号打断，这里只是防御
         if ((number < 0) && (errno != EINTR)) {
             printf("epoll failure\n");
             break;
         }
+        // 本批事件中刷新定时器都用这一次读到的时间
+        coarse_clock::update();
 
         // 循环遍历epoll返回的事件数组
         for (int i = 0; i < number; i++) {
             int sockfd = events[i].data.fd;
             // lfd，表示有客户端连接进来了
-            if (sockfd == listenfd) {
+            if (sockfd == r->listenfd) {
                 struct sockaddr_in client_address;
                 socklen_t client_addrlength = sizeof(client_address);
                 // cfd
-                int connfd = accept(listenfd, (struct sockaddr*)&client_address, &client_addrlength);
+                int connfd = accept(r->listenfd, (struct sockaddr*)&client_address, &client_addrlength);
                 if (connfd < 0) {
                     printf("errno is: %d\n", errno);
                     continue;
                 }
                 // 连接数已满
-                if (http_conn::m_user_count >= MAX_FD) {
+                if (connfd >= MAX_FD) {
                     close(connfd);
                     continue;
                 }
-                // 初始化客户信息，放进数组
-                users[connfd].init(connfd, client_address);
-
-                // 初始化client_timer数据
-                // 创建定时器，设置回调函数和超时时间，绑定用户数据，将定时器添加到链表中
-                users_timer[connfd].address = client_address;
-                users_timer[connfd].sockfd = connfd;
-                util_timer* timer = new util_timer;
-                timer->user_data = &users_timer[connfd];
-                // 回调函数
-                timer->cb_func = cb_func;
-                time_t cur = time(NULL);
-                // 设置超时时间为5倍TIMESLOT
-                timer->expire = cur + 5 * TIMESLOT;
-                users_timer[connfd].timer = timer;
-                timer_lst.add_timer(timer);
+                if (http_conn::m_user_count >= max_conn) {
+                    refuse_conn(connfd);
+                    continue;
+                }
+                if (!add_conn(r, connfd, client_address)) {
+                    refuse_conn(connfd);
+                }
                 // info
                 // printf("A connection comes.\n");
             }
             // 检测错误事件
             else if (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
                 // 服务器端关闭连接，移除对应的定时器
-                util_timer* timer = users_timer[sockfd].timer;
-                timer->cb_func(&users_timer[sockfd]);
-
-                if (timer) {
-                    timer_lst.del_timer(timer);
+                close_timer(r, sockfd);
+            }
+            // timerfd到期，读出到期次数
+            else if (sockfd == r->timerfd) {
+                uint64_t ticks;
+                if (read(r->timerfd, &ticks, sizeof(ticks)) > 0) {
+                    timeout = true;
                 }
-                // users[sockfd].close_conn();
             }
-            // 管道读端对应文件描述符发生读事件，则处理信号
-            else if ((sockfd == pipefd[0]) && (events[i].events & EPOLLIN)) {
-                int sig;
-                char signals[1024];
-                // 从管道读端读出信号值，成功返回字节数
-                ret = recv(pipefd[0], signals, sizeof(signals), 0);
-                if (ret == -1) {
-                    continue;
-                } else if (ret == 0) {
-                    continue;
-                } else {
-                    for (int i = 0; i < ret; ++i) {
-                        switch (signals[i]) {
-                            // 超时
-                            case SIGALRM: {
-                                timeout = true;
-                                // info
-                                // printf("SIGALRM reached!\n");
-                                break;
-                            }
-                            // 进程被杀死
-                            case SIGTERM: {
-                                stop_server = true;
-                                // info
-                                // printf("SIGTERM reached!\n");
-                            }
-                        }
-                    }
+            // signalfd可读，处理信号
+            else if (sockfd == r->sigfd) {
+                struct signalfd_siginfo si;
+                while (read(r->sigfd, &si, sizeof(si)) == sizeof(si)) {
+                    handle_signal(si);
                 }
             }
+            // MODEL_REACTOR：只派发就绪事件，读写由工作线程完成
+            else if (io_model == MODEL_REACTOR && (events[i].events & (EPOLLIN | EPOLLOUT))) {
+                refresh_timer(r, sockfd, (events[i].events & EPOLLIN) ? 5 : 3);
+                dispatch(r, sockfd, (events[i].events & EPOLLIN) ? http_conn::TASK_READ : http_conn::TASK_WRITE);
+            }
             // cfd上有读事件
             else if (events[i].events & EPOLLIN) {
-                // 该连接对应的定时器
-                util_timer* timer = users_timer[sockfd].timer;
-                if (users[sockfd].read()) {
+                if (users[sockfd]->read()) {
                     // 若监测到读事件，将该事件放入请求队列
-                    pool->append(users + sockfd);
-
-                    // 更新定时器在链表的位置
-                    if (timer) {
-                        time_t cur = time(NULL);
-                        timer->expire = cur + 5 * TIMESLOT;
-                        timer_lst.adjust_timer(timer);
-                    }
+                    refresh_timer(r, sockfd, 5);
+                    dispatch(r, sockfd);
                 } else {
                     // 服务器端关闭连接，移除对应的定时器
-                    timer->cb_func(&users_timer[sockfd]);
-                    if (timer) {
-                        timer_lst.del_timer(timer);
-                    }
-                    // users[sockfd].close_conn();
+                    close_timer(r, sockfd);
                 }
-            } 
+            }
             // cfd上有写事件
             else if (events[i].events & EPOLLOUT) {
-                util_timer* timer = users_timer[sockfd].timer;
-                if (users[sockfd].write()) {
-                    // 更新定时器在链表的位置
-                    if (timer) {
-                        time_t cur = time(NULL);
-                        timer->expire = cur + 3 * TIMESLOT;
-                        timer_lst.adjust_timer(timer);
-                    }
-                } else {
+                int state = users[sockfd]->write();
+                if (state == http_conn::WRITE_CLOSE) {
                     // 服务器端关闭连接，移除对应的定时器
-                    timer->cb_func(&users_timer[sockfd]);
-                    if (timer) {
-                        timer_lst.del_timer(timer);
+                    close_timer(r, sockfd);
+                } else {
+                    // WRITE_YIELD时write已经重新注册了EPOLLOUT，和WRITE_AGAIN一样等待下一轮
+                    refresh_timer(r, sockfd, 3);
+                    // 读缓冲区中还有未处理的流水线请求，直接再次分发
+                    if (state == http_conn::WRITE_PROCESS) {
+                        dispatch(r, sockfd);
+                    }
+                }
+            }
+        }
+        // 定时器到期并不是立马处理，完成读写事件后，再调用tick()处理本reactor时间轮中的定时器
+        if (timeout) {
+            r->timer_lst.tick();
+            timeout = false;
+        }
+        update_accept(r);
+    }
+
+    delete[] events;
+    return NULL;
+}
+
+// io_uring reactor线程的事件循环
+// accept为多次触发，recv由内核从提供缓冲区中挑选缓冲区，响应头和文件内容通过一次writev提交，
+// 工作线程处理完请求后经eventfd通知本线程提交下一次recv或writev，不再需要epoll_ctl
+void* uring_eventloop(void* arg) {
+    reactor* r = (reactor*)arg;
+    pin_thread(r->cpu);
+    uring_reactor* ring = r->uring;
+    std::vector<uring_post> posted;
+    bool timeout = false;
+
+    ring->prep_accept(r->listenfd);
+    r->accept_armed = true;
+    ring->prep_read(UR_TIMER, r->timerfd, &r->ticks, sizeof(r->ticks));
+    if (r->sigfd != -1) {
+        ring->prep_read(UR_SIGNAL, r->sigfd, &r->siginfo, sizeof(r->siginfo));
+    }
+    ring->prep_wakeup();
+
+    while (!stop_server) {
+        int ret = ring->submit_and_wait();
+        if (ret < 0 && errno != EINTR) {
+            printf("io_uring failure\n");
+            break;
+        }
+        coarse_clock::update();
+
+        struct io_uring_cqe* cqe;
+        while ((cqe = ring->peek_cqe()) != NULL) {
+            uint64_t data = cqe->user_data;
+            int res = cqe->res;
+            unsigned int flags = cqe->flags;
+            ring->cqe_seen();
+
+            int op = ur_op(data);
+            int sockfd = ur_fd(data);
+            // 已关闭连接的迟到事件：归还其占用的接收缓冲区后丢弃
+            if ((op == UR_RECV || op == UR_SEND) && ur_gen(data) != conn_gen[sockfd]) {
+                if (flags & IORING_CQE_F_BUFFER) {
+                    ring->prep_provide(flags >> IORING_CQE_BUFFER_SHIFT);
+                }
+                continue;
+            }
+
+            switch (op) {
+                // 新连接
+                case UR_ACCEPT: {
+                    // 多次触发的accept被内核终止或被取消，暂停accept时不再提交
+                    if (!(flags & IORING_CQE_F_MORE)) {
+                        r->accept_armed = false;
+                        if (r->accepting) {
+                            ring->prep_accept(r->listenfd);
+                            r->accept_armed = true;
+                        }
+                    }
+                    if (res < 0) {
+                        if (res != -ECANCELED) {
+                            printf("errno is: %d\n", -res);
+                        }
+                        break;
+                    }
+                    // 连接数已满
+                    if (res >= MAX_FD) {
+                        close(res);
+                        break;
+                    }
+                    if (http_conn::m_user_count >= max_conn) {
+                        refuse_conn(res);
+                        break;
+                    }
+                    // 多次触发的accept不返回对端地址
+                    struct sockaddr_in client_address;
+                    memset(&client_address, 0, sizeof(client_address));
+                    if (!add_conn(r, res, client_address)) {
+                        refuse_conn(res);
+                        break;
+                    }
+                    ring->prep_recv(res, conn_gen[res]);
+                    break;
+                }
+                // cfd上读到数据
+                case UR_RECV: {
+                    if (res == -ENOBUFS) {
+                        // 接收缓冲区暂时耗尽，归还的缓冲区随本批次一起提交
+                        ring->prep_recv(sockfd, conn_gen[sockfd]);
+                        break;
+                    }
+                    bool ok = res > 0;
+                    if (flags & IORING_CQE_F_BUFFER) {
+                        int bid = flags >> IORING_CQE_BUFFER_SHIFT;
+                        if (ok) {
+                            ok = users[sockfd]->append_read(ring->buffer(bid), res);
+                        }
+                        ring->prep_provide(bid);
+                    }
+                    if (ok) {
+                        // 将该事件放入请求队列
+                        refresh_timer(r, sockfd, 5);
+                        dispatch(r, sockfd);
+                    } else {
+                        // 对方关闭连接或出错，移除对应的定时器
+                        close_timer(r, sockfd);
+                    }
+                    break;
+                }
+                // cfd上数据发送完成
+                case UR_SEND: {
+                    if (res < 0) {
+                        close_timer(r, sockfd);
+                        break;
+                    }
+                    if (!users[sockfd]->advance_write(res)) {
+                        // 部分发送，继续发送剩余数据
+                        int count;
+                        struct iovec* iov = users[sockfd]->write_iov(&count);
+                        ring->prep_writev(sockfd, conn_gen[sockfd], iov, count);
+                    } else {
+                        int state = users[sockfd]->finish_write();
+                        if (state == http_conn::WRITE_READ) {
+                            // 长连接，等待下一个请求
+                            ring->prep_recv(sockfd, conn_gen[sockfd]);
+                            refresh_timer(r, sockfd, 3);
+                        } else if (state == http_conn::WRITE_PROCESS) {
+                            // 读缓冲区中还有未处理的流水线请求
+                            refresh_timer(r, sockfd, 3);
+                            dispatch(r, sockfd);
+                        } else {
+                            close_timer(r, sockfd);
+                        }
+                    }
+                    break;
+                }
+                // timerfd到期
+                case UR_TIMER: {
+                    if (res > 0) {
+                        timeout = true;
                     }
-                    // users[sockfd].close_conn();
+                    ring->prep_read(UR_TIMER, r->timerfd, &r->ticks, sizeof(r->ticks));
+                    break;
                 }
+                // 信号
+                case UR_SIGNAL: {
+                    if (res == sizeof(r->siginfo)) {
+                        handle_signal(r->siginfo);
+                    }
+                    ring->prep_read(UR_SIGNAL, r->sigfd, &r->siginfo, sizeof(r->siginfo));
+                    break;
+                }
+                // 工作线程请求提交recv或writev
+                case UR_WAKEUP: {
+                    ring->take_posted(posted);
+                    for (size_t j = 0; j < posted.size(); ++j) {
+                        int fd = posted[j].fd;
+                        // 连接已经被定时器关闭，或fd已被复用为新连接(可能属于其他reactor)
+                        // slot的内存在slab销毁前不归还，即使刚被其他reactor放回也可以读取
+                        conn_slot* slot = slots[fd];
+                        if (!slot || slot->timer.reactor != r->id || conn_gen[fd] != posted[j].gen) {
+                            continue;
+                        }
+                        if (posted[j].ev == EPOLLOUT) {
+                            int count;
+                            struct iovec* iov = users[fd]->write_iov(&count);
+                            ring->prep_writev(fd, conn_gen[fd], iov, count);
+                        } else {
+                            ring->prep_recv(fd, conn_gen[fd]);
+                        }
+                    }
+                    posted.clear();
+                    ring->prep_wakeup();
+                    break;
+                }
+                default:
+                    break;
             }
         }
-        // 收到信号并不是立马处理，完成读写事件后，再进行处理
+
+        // 完成本批事件后再处理定时器
         if (timeout) {
-            timer_handler();
+            r->timer_lst.tick();
             timeout = false;
         }
+        update_accept(r);
+    }
+    return NULL;
+}
+
+int main(int argc, char* argv[]) {
+    config conf;
+    if (!conf.parse_arg(argc, argv)) {
+        config::usage(basename(argv[0]));
+        return 1;
+    }
+
+    // 注册信号捕捉，因为一端断开后另一端还继续写数据会产生SIGPIPE信号，默认会终止进程，这里选择忽略
+    addsig(SIGPIPE, SIG_IGN);
+    // SIGTERM/SIGHUP改由0号reactor的signalfd接收，必须在创建任何线程之前屏蔽，
+    // 否则信号可能递送给没有屏蔽它的工作线程
+    sigset_t mask;
+    signal_mask(&mask);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    // 数据库连接池
+    connection_pool *connPool = connection_pool::GetInstance();
+    connPool->init("localhost", "rjgc", "rjgc123", "WebServerDB", 3306, 8);
+
+    // 线程池，每个通道一个；reactor绑定在序号0..reactor_num-1的CPU上，各线程池依次接在后面
+    try {
+        int first_cpu = conf.reactor_num;
+        for (int i = 0; i < LANE_NUM; ++i) {
+            lanes[i].pool =
+                new threadpool<http_conn>(conf.lanes[i].threads, conf.lanes[i].max_requests, first_cpu);
+            first_cpu += conf.lanes[i].threads;
+            lanes[i].policy = conf.lanes[i].policy;
+            lanes[i].overflow = 0;
+            lanes[i].shed = 0;
+        }
+    } catch (...) {
+        return 1;
+    }
+    printf("Thread pool created.\n");
+
+    // 过载保护
+    if (conf.max_conn > 0 && conf.max_conn < MAX_FD) {
+        max_conn = conf.max_conn;
+    }
+    max_wait_us = conf.max_wait_ms * 1000UL;
+    http_conn::init_responses(conf.retry_after);
+    http_conn::set_max_request(conf.max_request_kb * 1024);
+    http_conn::set_write_budget(conf.write_budget_kb * 1024);
+    // io_uring的读写由内核完成，没有可以交给工作线程的部分
+    if (conf.io_model == MODEL_REACTOR && conf.io_backend == IO_EPOLL) {
+        io_model = MODEL_REACTOR;
+        http_conn::set_io_model(MODEL_REACTOR, handoff);
     }
-    
-    close(epollfd);
-    close(listenfd);
-    close(pipefd[1]);
-    close(pipefd[0]);
+    http_conn::set_file_send(conf.file_send);
+    http_conn::set_cache_rules(conf.cache_rules, conf.cache_rule_count);
+    http_conn::init_compression((size_t)conf.zip_cache_mb << 20);
+    int preloaded = http_conn::init_file_cache((size_t)conf.cache_mb << 20, conf.preload);
+    if (conf.preload) {
+        printf("File cache preloaded %d files.\n", preloaded);
+    }
+    if (conf.cache_mb > 0 || conf.zip_cache_mb > 0) {
+        int watched = http_conn::watch_files();
+        if (watched < 0) {
+            printf("inotify init failure, cached files will not be refreshed, errno is: %d\n", errno);
+        } else {
+            printf("Watching %d directories for changes.\n", watched);
+        }
+    }
+
+    // 保存客户端信息
+    users = new http_conn*[MAX_FD]();
+    // 初始化数据库读取表
+    http_conn::initmysql_result(connPool);
+    slots = new conn_slot*[MAX_FD]();
+    conn_gen = new unsigned int[MAX_FD]();
+
+    // 创建reactor，每个reactor有自己的监听socket和epoll
+    reactor_num = conf.reactor_num;
+    reactors = new reactor[reactor_num];
+    for (int i = 0; i < reactor_num; ++i) {
+        if (!reactor_init(&reactors[i], i, conf)) {
+            printf("reactor %d init failure, errno is: %d\n", i, errno);
+            return 1;
+        }
+    }
+    printf("%d %s reactors listening on port %d (%s mode).\n", reactor_num,
+           conf.io_backend == IO_URING ? "io_uring" : "epoll", conf.port,
+           io_model == MODEL_REACTOR ? "reactor" : "proactor");
+
+    void* (*loop)(void*) = (conf.io_backend == IO_URING) ? uring_eventloop : eventloop;
+    for (int i = 1; i < reactor_num; ++i) {
+        if (pthread_create(&reactors[i].thread, NULL, loop, &reactors[i]) != 0) {
+            printf("reactor %d create failure\n", i);
+            return 1;
+        }
+    }
+    // 主线程运行0号reactor
+    reactors[0].thread = pthread_self();
+    loop(&reactors[0]);
+    for (int i = 1; i < reactor_num; ++i) {
+        pthread_join(reactors[i].thread, NULL);
+    }
+
+    for (int i = 0; i < reactor_num; ++i) {
+        if (reactors[i].epollfd != -1) {
+            close(reactors[i].epollfd);
+        }
+        delete reactors[i].uring;
+        close(reactors[i].listenfd);
+        close(reactors[i].timerfd);
+        if (reactors[i].sigfd != -1) {
+            close(reactors[i].sigfd);
+        }
+    }
+    delete[] reactors;
     delete[] users;
-    delete[] users_timer;
-    delete pool;
+    delete[] slots;
+    delete[] conn_gen;
+    for (int i = 0; i < LANE_NUM; ++i) {
+        delete lanes[i].pool;
+    }
     return 0;
 }
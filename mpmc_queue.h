@@ -0,0 +1,129 @@
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+#include <stddef.h>
+#include <atomic>
+#include <exception>
+
+#define CACHELINE_SIZE 64
+
+// 有界无锁多生产者多消费者队列(环形缓冲区)
+// 每个槽带一个序号：序号等于入队位置时可写，等于位置+1时可读，出队后置为位置+容量供下一圈使用
+// 入队位置和出队位置各占一个缓存行，避免生产者与消费者之间的伪共享
+// 每个元素可以附带一个时间戳(如入队时间)，head_stamp读取队头元素的时间戳而不取走它
+template <typename T>
+class mpmc_queue {
+   public:
+    // 容量就是最多允许等待处理的元素个数，不要求是2的幂
+    explicit mpmc_queue(size_t capacity) : m_capacity(capacity), m_enqueue_pos(0), m_dequeue_pos(0) {
+        if (capacity == 0) {
+            throw std::exception();
+        }
+        m_cells = new cell[capacity];
+        for (size_t i = 0; i < capacity; ++i) {
+            m_cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+    ~mpmc_queue() { delete[] m_cells; }
+
+    // 入队，队列已满返回false
+    bool push(const T& data, unsigned long stamp = 0) {
+        size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        cell* c;
+        while (true) {
+            c = &m_cells[pos % m_capacity];
+            size_t seq = c->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                // 槽可写，抢占这个位置
+                if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // 槽中还是上一圈未被取走的元素，队列已满
+                return false;
+            } else {
+                pos = m_enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        c->data = data;
+        c->stamp.store(stamp, std::memory_order_relaxed);
+        c->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 出队，队列为空返回false
+    bool pop(T& data) {
+        size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        cell* c;
+        while (true) {
+            c = &m_cells[pos % m_capacity];
+            size_t seq = c->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // 槽还没有被写入，队列为空
+                return false;
+            } else {
+                pos = m_dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        data = c->data;
+        c->seq.store(pos + m_capacity, std::memory_order_release);
+        return true;
+    }
+
+    // 队头元素入队时附带的时间戳，队列为空返回false
+    // 读取前后槽的序号都等于出队位置+1时，读到的时间戳就属于该位置的元素；中途被取走则重试
+    bool head_stamp(unsigned long* stamp) const {
+        while (true) {
+            size_t pos = m_dequeue_pos.load(std::memory_order_acquire);
+            const cell* c = &m_cells[pos % m_capacity];
+            if (c->seq.load(std::memory_order_acquire) != pos + 1) {
+                // 槽还没有被写入(队列为空)，或已被取走、出队位置还没更新
+                if (m_dequeue_pos.load(std::memory_order_acquire) == pos) {
+                    return false;
+                }
+                continue;
+            }
+            unsigned long s = c->stamp.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (c->seq.load(std::memory_order_relaxed) == pos + 1) {
+                *stamp = s;
+                return true;
+            }
+        }
+    }
+
+    // 近似的元素个数，仅用于统计
+    size_t size() const {
+        size_t tail = m_enqueue_pos.load(std::memory_order_relaxed);
+        size_t head = m_dequeue_pos.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+    size_t capacity() const { return m_capacity; }
+
+   private:
+    struct cell {
+        std::atomic<size_t> seq;
+        std::atomic<unsigned long> stamp;
+        T data;
+    };
+
+    // 禁止拷贝
+    mpmc_queue(const mpmc_queue&);
+    mpmc_queue& operator=(const mpmc_queue&);
+
+   private:
+    const size_t m_capacity;
+    cell* m_cells;
+    alignas(CACHELINE_SIZE) std::atomic<size_t> m_enqueue_pos;
+    alignas(CACHELINE_SIZE) std::atomic<size_t> m_dequeue_pos;
+    char m_pad[CACHELINE_SIZE - sizeof(std::atomic<size_t>)];
+};
+
+#endif
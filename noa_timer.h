@@ -4,53 +4,56 @@
 #include <time.h>
 #include <netinet/in.h>
 
-class util_timer;
-// 封装用户连接信息和定时器
-struct client_timer {
-    sockaddr_in address;
-    int sockfd;
-    util_timer* timer;
-};
+struct client_timer;
 
 // 定时器(双向链表)
+// 定时器节点直接嵌入client_timer，容器只负责链接，不申请也不释放节点
 class util_timer {
    public:
-    util_timer() : prev(NULL), next(NULL) {}
+    util_timer() : slot(-1), prev(NULL), next(NULL) {}
+    // 是否挂在时间轮中
+    bool active() const { return slot != -1; }
 
    public:
-    // 超时时间 
+    // 超时时间，sort_timer_lst为秒，time_wheel为单调时钟毫秒
     time_t expire;
     // 回调函数
     void (*cb_func)(client_timer*);
     // 用户连接信息
     client_timer* user_data;
+    // 在时间轮中所处的槽，sort_timer_lst不使用
+    int slot;
     util_timer* prev;
     util_timer* next;
 };
 
+// 封装用户连接信息和定时器
+struct client_timer {
+    sockaddr_in address;
+    int sockfd;
+    int epollfd;  // 连接所属reactor的epoll
+    int reactor;  // 连接所属reactor的序号，连接对象从它的slab中分配
+    util_timer timer;
+};
+
 // 定时器容器类
 class sort_timer_lst {
    public:
     sort_timer_lst() : head(NULL), tail(NULL) {}
-    // 销毁链表
-    ~sort_timer_lst() {
-        util_timer* tmp = head;
-        while (tmp) {
-            head = tmp->next;
-            delete tmp;
-            tmp = head;
-        }
-    }
+    // 节点由使用者持有，销毁链表时不释放
+    ~sort_timer_lst() {}
     // 添加定时器
     void add_timer(util_timer* timer) {
         if (!timer) {
             return;
         }
         if (!head) {
+            timer->prev = timer->next = NULL;
             head = tail = timer;
             return;
         }
         if (timer->expire < head->expire) {
+            timer->prev = NULL;
             timer->next = head;
             head->prev = timer;
             head = timer;
@@ -84,26 +87,20 @@ class sort_timer_lst {
             return;
         }
         if ((timer == head) && (timer == tail)) {
-            delete timer;
             head = NULL;
             tail = NULL;
-            return;
-        }
-        if (timer == head) {
+        } else if (timer == head) {
             head = head->next;
             head->prev = NULL;
-            delete timer;
-            return;
-        }
-        if (timer == tail) {
+        } else if (timer == tail) {
             tail = tail->prev;
             tail->next = NULL;
-            delete timer;
-            return;
+        } else {
+            timer->prev->next = timer->next;
+            timer->next->prev = timer->prev;
         }
-        timer->prev->next = timer->next;
-        timer->next->prev = timer->prev;
-        delete timer;
+        timer->prev = NULL;
+        timer->next = NULL;
     }
     // 定时任务处理函数，删除超时的定时器
     void tick() {
@@ -119,13 +116,16 @@ class sort_timer_lst {
             if (cur < tmp->expire) {
                 break;
             }
-            // 当前定时器到期，则调用回调函数删除非活动连接在socket上的注册事件，并关闭
-            tmp->cb_func(tmp->user_data);
+            // 当前定时器到期，先摘下再调用回调函数删除非活动连接在socket上的注册事件，并关闭
             head = tmp->next;
             if (head) {
                 head->prev = NULL;
+            } else {
+                tail = NULL;
             }
-            delete tmp;
+            tmp->prev = NULL;
+            tmp->next = NULL;
+            tmp->cb_func(tmp->user_data);
             tmp = head;
         }
     }
@@ -159,4 +159,110 @@ class sort_timer_lst {
     util_timer* tail;
 };
 
+// 时间轮(哈希定时器)，每个槽宽tick_ms毫秒，定时器挂在(expire / tick_ms) % N_SLOTS号槽的双向链表中
+// 添加、调整、删除都是O(1)，tick只遍历从上次tick所在的槽到当前槽之间的槽
+// 时间轮中的expire是CLOCK_MONOTONIC_COARSE毫秒数，超过一圈的定时器在槽中保留到expire真正到期为止
+class time_wheel {
+   public:
+    static const int N_SLOTS = 1024;
+
+    time_wheel() : tick_ms(1000), cur_tick(now_ms() / 1000) {
+        for (int i = 0; i < N_SLOTS; ++i) {
+            slots[i] = NULL;
+        }
+    }
+    // 节点由使用者持有，销毁时不释放
+    ~time_wheel() {}
+    // 设置槽宽(毫秒)，须在添加定时器之前调用
+    void init(int ms) {
+        tick_ms = ms > 0 ? ms : 1;
+        cur_tick = now_ms() / tick_ms;
+    }
+    // 当前的单调时钟(毫秒)，与coarse_clock::now_ms()同为COARSE时钟，超时时间和tick的比较不会错位
+    static time_t now_ms() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    }
+    // 添加定时器
+    void add_timer(util_timer* timer) {
+        if (!timer) {
+            return;
+        }
+        // 已经过期的定时器放到下一次tick要处理的第一个槽
+        time_t t = timer->expire / tick_ms;
+        if (t < cur_tick) {
+            t = cur_tick;
+        }
+        int slot = t % N_SLOTS;
+        timer->slot = slot;
+        timer->prev = NULL;
+        timer->next = slots[slot];
+        if (slots[slot]) {
+            slots[slot]->prev = timer;
+        }
+        slots[slot] = timer;
+    }
+    // 调整定时器，expire已更新，移到新的槽
+    void adjust_timer(util_timer* timer) {
+        if (!timer || !timer->active()) {
+            return;
+        }
+        unlink(timer);
+        add_timer(timer);
+    }
+    // 删除定时器
+    void del_timer(util_timer* timer) {
+        if (!timer || !timer->active()) {
+            return;
+        }
+        unlink(timer);
+    }
+    // 定时任务处理函数，处理从上次tick所在的槽到当前槽的每一个槽，删除其中到期的定时器
+    // 上次tick所在的槽只经过了一部分，其中expire还没到的定时器要留到下一次tick再检查
+    void tick() {
+        time_t cur = now_ms();
+        time_t now_tick = cur / tick_ms;
+        if (now_tick < cur_tick) {
+            return;
+        }
+        // 间隔超过一圈时每个槽只需遍历一次
+        time_t start = (now_tick - cur_tick >= N_SLOTS) ? now_tick - N_SLOTS + 1 : cur_tick;
+        for (time_t t = start; t <= now_tick; ++t) {
+            util_timer* tmp = slots[t % N_SLOTS];
+            while (tmp) {
+                util_timer* next = tmp->next;
+                // 当前定时器到期，先摘下再调用回调函数删除非活动连接在socket上的注册事件，并关闭
+                if (tmp->expire <= cur) {
+                    unlink(tmp);
+                    tmp->cb_func(tmp->user_data);
+                }
+                tmp = next;
+            }
+        }
+        cur_tick = now_tick;
+    }
+
+   private:
+    // 从所在槽的链表中摘下，节点回到未激活状态
+    void unlink(util_timer* timer) {
+        if (timer->prev) {
+            timer->prev->next = timer->next;
+        } else {
+            slots[timer->slot] = timer->next;
+        }
+        if (timer->next) {
+            timer->next->prev = timer->prev;
+        }
+        timer->prev = NULL;
+        timer->next = NULL;
+        timer->slot = -1;
+    }
+
+   private:
+    util_timer* slots[N_SLOTS];
+    int tick_ms;      // 槽宽
+    time_t cur_tick;  // 上次tick所在的槽序号，之前的槽都已处理完
+};
+
 #endif
@@ -0,0 +1,244 @@
+// 事件处理模式基准：用长连接反复请求同一个文件，报告吞吐量和请求延迟分位数
+// 配合mode_bench.sh分别测试-a proactor与-a reactor下的小文件和大文件
+// 每个线程一个epoll，负责conns/threads个连接；每个连接收完一个应答后立即发送下一个请求
+// 编译：g++ -O2 -pthread mode_bench.cpp -o mode_bench
+// 运行：./mode_bench host port path [连接数] [秒数] [线程数]
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+
+static sockaddr_in server;
+static char request[512];
+static int request_len;
+static uint64_t deadline_ns;
+static pthread_barrier_t ready;
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+struct bench_conn {
+    int fd;
+    uint64_t start_ns;  // 当前请求的发送时间
+    char head[1024];    // 应答头部
+    int head_len;
+    long long body_left;  // -1表示还在读头部
+    bool warm;            // 已完成过一个请求；第一个请求含建立连接时监听队列溢出的重传，不计入延迟
+};
+
+struct worker {
+    pthread_t thread;
+    int conns;
+    int seconds;
+    unsigned long requests;
+    unsigned long errors;
+    unsigned long long bytes;
+    std::vector<uint32_t> latency_us;
+};
+
+static bool send_request(bench_conn* c) {
+    c->start_ns = now_ns();
+    c->head_len = 0;
+    c->body_left = -1;
+    // 请求很短，一次写完
+    return write(c->fd, request, request_len) == request_len;
+}
+
+// 阻塞connect：监听队列满时会等SYN重传，所以计时开始前先建好所有连接
+static bool open_conn(int epfd, bench_conn* c) {
+    c->warm = false;
+    c->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (c->fd < 0 || connect(c->fd, (sockaddr*)&server, sizeof(server)) < 0) {
+        if (c->fd >= 0) {
+            close(c->fd);
+        }
+        return false;
+    }
+    int one = 1;
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(c->fd, F_SETFL, fcntl(c->fd, F_GETFL) | O_NONBLOCK);
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = c;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, c->fd, &ev);
+    return true;
+}
+
+// 读到的数据先补全头部，再按Content-Length计算剩余的正文；返回false表示连接出错
+static bool on_readable(worker* w, bench_conn* c, char* buf, int size) {
+    while (true) {
+        ssize_t n = read(c->fd, buf, size);
+        if (n < 0) {
+            return errno == EAGAIN;
+        }
+        if (n == 0) {
+            return false;
+        }
+        w->bytes += n;
+        char* p = buf;
+        while (n > 0) {
+            if (c->body_left < 0) {
+                int take = std::min((int)n, (int)sizeof(c->head) - 1 - c->head_len);
+                memcpy(c->head + c->head_len, p, take);
+                c->head_len += take;
+                c->head[c->head_len] = '\0';
+                char* end = strstr(c->head, "\r\n\r\n");
+                if (!end) {
+                    if (c->head_len == (int)sizeof(c->head) - 1) {
+                        return false;
+                    }
+                    p += take;
+                    n -= take;
+                    continue;
+                }
+                int used = end + 4 - c->head;
+                // 本次读到的数据中头部之后的部分
+                int extra = c->head_len - used;
+                p += take - extra;
+                n -= take - extra;
+                const char* cl = strcasestr(c->head, "Content-Length:");
+                if (strncmp(c->head, "HTTP/1.1 200", 12) != 0 || !cl) {
+                    return false;
+                }
+                c->body_left = atoll(cl + 15);
+            }
+            long long take = std::min((long long)n, c->body_left);
+            c->body_left -= take;
+            p += take;
+            n -= take;
+            if (c->body_left == 0) {
+                uint64_t t = now_ns();
+                if (c->warm) {
+                    w->latency_us.push_back((t - c->start_ns) / 1000);
+                }
+                c->warm = true;
+                w->requests++;
+                if (n > 0) {
+                    return false;  // 没有流水线请求，不应有多余的数据
+                }
+                if (t >= deadline_ns) {
+                    return true;
+                }
+                if (!send_request(c)) {
+                    return false;
+                }
+            }
+        }
+    }
+}
+
+static void* run(void* arg) {
+    worker* w = (worker*)arg;
+    int epfd = epoll_create1(0);
+    std::vector<bench_conn> conns(w->conns);
+    for (int i = 0; i < w->conns; ++i) {
+        if (!open_conn(epfd, &conns[i])) {
+            w->errors++;
+            conns[i].fd = -1;
+        }
+    }
+    // 所有线程都建好连接后由其中一个设置截止时间，再同时开始发请求
+    if (pthread_barrier_wait(&ready) == PTHREAD_BARRIER_SERIAL_THREAD) {
+        deadline_ns = now_ns() + w->seconds * 1000000000ULL;
+    }
+    pthread_barrier_wait(&ready);
+    for (int i = 0; i < w->conns; ++i) {
+        if (conns[i].fd >= 0 && !send_request(&conns[i])) {
+            w->errors++;
+        }
+    }
+    std::vector<char> buf(256 * 1024);
+    epoll_event events[64];
+    while (now_ns() < deadline_ns) {
+        int n = epoll_wait(epfd, events, 64, 100);
+        for (int i = 0; i < n; ++i) {
+            bench_conn* c = (bench_conn*)events[i].data.ptr;
+            if (!on_readable(w, c, buf.data(), buf.size())) {
+                // 出错的连接重新建立
+                w->errors++;
+                epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+                close(c->fd);
+                if (!open_conn(epfd, c)) {
+                    c->fd = -1;
+                } else if (!send_request(c)) {
+                    close(c->fd);
+                    c->fd = -1;
+                }
+            }
+        }
+    }
+    for (int i = 0; i < w->conns; ++i) {
+        if (conns[i].fd >= 0) {
+            close(conns[i].fd);
+        }
+    }
+    close(epfd);
+    return NULL;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        printf("usage: %s host port path [conns] [seconds] [threads]\n", argv[0]);
+        return 1;
+    }
+    int conns = argc > 4 ? atoi(argv[4]) : 64;
+    int seconds = argc > 5 ? atoi(argv[5]) : 10;
+    int threads = argc > 6 ? atoi(argv[6]) : 2;
+    if (conns <= 0 || seconds <= 0 || threads <= 0) {
+        return 1;
+    }
+    if (threads > conns) {
+        threads = conns;
+    }
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    server.sin_port = htons(atoi(argv[2]));
+    if (inet_pton(AF_INET, argv[1], &server.sin_addr) != 1) {
+        printf("bad host %s\n", argv[1]);
+        return 1;
+    }
+    request_len = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: keep-alive\r\n\r\n",
+                           argv[3], argv[1]);
+
+    std::vector<worker> workers(threads);
+    pthread_barrier_init(&ready, NULL, threads);
+    for (int i = 0; i < threads; ++i) {
+        workers[i].conns = conns / threads + (i < conns % threads ? 1 : 0);
+        workers[i].seconds = seconds;
+        workers[i].requests = workers[i].errors = 0;
+        workers[i].bytes = 0;
+        pthread_create(&workers[i].thread, NULL, run, &workers[i]);
+    }
+    unsigned long requests = 0, errors = 0;
+    unsigned long long bytes = 0;
+    std::vector<uint32_t> latency;
+    for (int i = 0; i < threads; ++i) {
+        pthread_join(workers[i].thread, NULL);
+        requests += workers[i].requests;
+        errors += workers[i].errors;
+        bytes += workers[i].bytes;
+        latency.insert(latency.end(), workers[i].latency_us.begin(), workers[i].latency_us.end());
+    }
+    pthread_barrier_destroy(&ready);
+    std::sort(latency.begin(), latency.end());
+    size_t n = latency.size();
+    printf("%s: %d conns, %ds, %lu requests (%.0f req/s), %.1f MB/s, errors %lu, "
+           "latency p50 %uus p99 %uus max %uus\n",
+           argv[3], conns, seconds, requests, (double)requests / seconds, bytes / 1048576.0 / seconds, errors,
+           n ? latency[n / 2] : 0, n ? latency[n * 99 / 100] : 0, n ? latency[n - 1] : 0);
+    return 0;
+}
@@ -0,0 +1,32 @@
+#!/bin/bash
+# 比较-a proactor与-a reactor：每种模式各启动一次服务器，分别用小文件和大文件压测
+# 大文件在doc_root下临时生成，测完删除；其余参数原样传给服务器，如 -r 2 -C 0 -s mmap
+# 运行：./mode_bench.sh [端口] [服务器参数...]
+# 环境变量：SERVER(默认../webserver)、DOC_ROOT、CONNS、SECONDS_EACH、THREADS、LARGE_KB
+cd "$(dirname "$0")"
+PORT=${1:-9006}
+shift
+SERVER=${SERVER:-../webserver}
+DOC_ROOT=${DOC_ROOT:-/home/ljc/webserver/resources}
+CONNS=${CONNS:-64}
+SECONDS_EACH=${SECONDS_EACH:-10}
+THREADS=${THREADS:-2}
+LARGE_KB=${LARGE_KB:-1024}
+
+if [ ! -x ./mode_bench ] || [ mode_bench.cpp -nt mode_bench ]; then
+    g++ -O2 -pthread mode_bench.cpp -o mode_bench || exit 1
+fi
+LARGE=mode_bench_${LARGE_KB}k.bin
+head -c $((LARGE_KB * 1024)) /dev/urandom > "$DOC_ROOT/$LARGE" || exit 1
+trap 'rm -f "$DOC_ROOT/$LARGE"' EXIT
+
+for model in proactor reactor; do
+    "$SERVER" -a $model "$@" $PORT > /dev/null &
+    pid=$!
+    sleep 1
+    echo "== -a $model $*"
+    ./mode_bench 127.0.0.1 $PORT /index.html $CONNS $SECONDS_EACH $THREADS
+    ./mode_bench 127.0.0.1 $PORT /$LARGE $CONNS $SECONDS_EACH $THREADS
+    kill -TERM $pid
+    wait $pid 2> /dev/null
+done
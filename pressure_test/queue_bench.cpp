@@ -0,0 +1,163 @@
+// 请求队列微基准：比较原来的 std::list + 互斥锁 + 信号量 与 无锁环形队列 + 事件计数
+// 生产者与消费者线程数相同，从1到64，报告吞吐量和入队到出队的平均延迟
+// 编译：g++ -O2 -pthread -I.. queue_bench.cpp -o queue_bench
+// 运行：./queue_bench [每轮总元素数]
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <atomic>
+#include <list>
+#include <vector>
+#include "locker.h"
+#include "mpmc_queue.h"
+
+static const int MAX_REQUESTS = 10000;
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// 原threadpool<T>的请求队列
+class locked_queue {
+   public:
+    bool push(uint64_t v) {
+        m_locker.lock();
+        if (m_list.size() > MAX_REQUESTS) {
+            m_locker.unlock();
+            return false;
+        }
+        m_list.push_back(v);
+        m_locker.unlock();
+        m_stat.post();
+        return true;
+    }
+    bool pop(uint64_t& v) {
+        m_stat.wait();
+        m_locker.lock();
+        if (m_list.empty()) {
+            m_locker.unlock();
+            return false;
+        }
+        v = m_list.front();
+        m_list.pop_front();
+        m_locker.unlock();
+        return true;
+    }
+    void wake_all(int n) {
+        for (int i = 0; i < n; ++i) {
+            m_stat.post();
+        }
+    }
+
+   private:
+    std::list<uint64_t> m_list;
+    locker m_locker;
+    sem m_stat;
+};
+
+// 新threadpool<T>的请求队列
+class lockfree_queue {
+   public:
+    lockfree_queue() : m_queue(MAX_REQUESTS) {}
+    bool push(uint64_t v) {
+        if (!m_queue.push(v)) {
+            return false;
+        }
+        m_stat.notify();
+        return true;
+    }
+    bool pop(uint64_t& v) {
+        if (m_queue.pop(v)) {
+            return true;
+        }
+        uint32_t key = m_stat.prepare_wait();
+        if (m_queue.pop(v)) {
+            m_stat.cancel_wait();
+            return true;
+        }
+        m_stat.wait(key);
+        return false;
+    }
+    void wake_all(int) { m_stat.notify_all(); }
+
+   private:
+    mpmc_queue<uint64_t> m_queue;
+    eventcount m_stat;
+};
+
+template <typename Q>
+struct bench_ctx {
+    Q queue;
+    long per_producer;
+    long total;
+    std::atomic<long> consumed;
+    std::atomic<uint64_t> latency_sum;
+};
+
+template <typename Q>
+static void* producer(void* arg) {
+    bench_ctx<Q>* ctx = (bench_ctx<Q>*)arg;
+    for (long i = 0; i < ctx->per_producer; ++i) {
+        // 队列满时让出CPU，与主循环丢弃请求不同，这里保证每个元素都被处理
+        while (!ctx->queue.push(now_ns())) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+template <typename Q>
+static void* consumer(void* arg) {
+    bench_ctx<Q>* ctx = (bench_ctx<Q>*)arg;
+    uint64_t sum = 0;
+    uint64_t v;
+    while (ctx->consumed.load(std::memory_order_relaxed) < ctx->total) {
+        if (!ctx->queue.pop(v)) {
+            continue;
+        }
+        sum += now_ns() - v;
+        if (ctx->consumed.fetch_add(1) + 1 == ctx->total) {
+            ctx->queue.wake_all(1024);
+        }
+    }
+    ctx->latency_sum += sum;
+    return NULL;
+}
+
+template <typename Q>
+static void bench(const char* name, int threads, long total) {
+    bench_ctx<Q>* ctx = new bench_ctx<Q>;
+    ctx->per_producer = total / threads;
+    ctx->total = ctx->per_producer * threads;
+    ctx->consumed = 0;
+    ctx->latency_sum = 0;
+
+    std::vector<pthread_t> tids(threads * 2);
+    uint64_t start = now_ns();
+    for (int i = 0; i < threads; ++i) {
+        pthread_create(&tids[i], NULL, consumer<Q>, ctx);
+    }
+    for (int i = 0; i < threads; ++i) {
+        pthread_create(&tids[threads + i], NULL, producer<Q>, ctx);
+    }
+    for (int i = 0; i < threads * 2; ++i) {
+        pthread_join(tids[i], NULL);
+    }
+    double secs = (now_ns() - start) / 1e9;
+    printf("%-14s %2dP/%2dC  %10.0f ops/s  avg latency %10.1f us\n", name, threads, threads,
+           ctx->total / secs, ctx->latency_sum / (double)ctx->total / 1000.0);
+    delete ctx;
+}
+
+int main(int argc, char* argv[]) {
+    long total = argc > 1 ? atol(argv[1]) : 1000000;
+    for (int threads = 1; threads <= 64; threads *= 2) {
+        bench<locked_queue>("list+mutex", threads, total);
+        bench<lockfree_queue>("mpmc+futex", threads, total);
+    }
+    return 0;
+}
@@ -0,0 +1,140 @@
+// 定时器容器微基准：比较升序链表sort_timer_lst与时间轮time_wheel
+// 另外检查时间轮的精度：每个定时器都要在超时时间之后一个tick之内触发，否则返回1
+// 编译：g++ -O2 -I.. timer_bench.cpp -o timer_bench
+// 运行：./timer_bench
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+#include "noa_timer.h"
+
+static void cb_func(client_timer*) {}
+
+// 精度检查中定时器触发时的时间，下标为client_timer在数组中的位置
+static client_timer* fired_base;
+static std::vector<time_t> fired_ms;
+
+static void record_func(client_timer* user) { fired_ms[user - fired_base] = time_wheel::now_ms(); }
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// n个定时器常驻容器中，测量添加、调整(刷新超时时间)、删除的单次耗时
+// 链表的调整和添加是O(n)，因此只对ops个定时器计时
+template <typename LIST>
+static void bench(const char* name, int n, int ops) {
+    LIST* lst = new LIST;
+    // 定时器节点由使用者持有，容器只负责链接
+    std::vector<util_timer> nodes(n + ops);
+    std::vector<util_timer*> timers(n);
+    std::vector<client_timer> users(n);
+    // 两种容器都使用毫秒时间戳，1秒内16个定时器
+    time_t base = time_wheel::now_ms() + 1000000;
+    // 按超时时间递减的顺序插入，使链表的建立本身是O(n)
+    for (int i = n - 1; i >= 0; --i) {
+        util_timer* timer = &nodes[i];
+        timer->cb_func = cb_func;
+        timer->user_data = &users[i];
+        timer->expire = base + (i / 16) * 1000;
+        timers[i] = timer;
+        lst->add_timer(timer);
+    }
+
+    // 刷新：与主循环中的读写事件相同，把超时时间推后到当前最晚的时间之后
+    srand(1);
+    time_t latest = base + (n / 16) * 1000;
+    double start = now_ns();
+    for (int i = 0; i < ops; ++i) {
+        util_timer* timer = timers[rand() % n];
+        latest += 1000;
+        timer->expire = latest;
+        lst->adjust_timer(timer);
+    }
+    double adjust_ns = (now_ns() - start) / ops;
+
+    // 新连接
+    std::vector<util_timer*> extra(ops);
+    start = now_ns();
+    for (int i = 0; i < ops; ++i) {
+        util_timer* timer = &nodes[n + i];
+        timer->cb_func = cb_func;
+        timer->user_data = &users[i % n];
+        timer->expire = latest;
+        extra[i] = timer;
+        lst->add_timer(timer);
+    }
+    double add_ns = (now_ns() - start) / ops;
+
+    // 关闭连接
+    start = now_ns();
+    for (int i = 0; i < ops; ++i) {
+        lst->del_timer(extra[i]);
+    }
+    double del_ns = (now_ns() - start) / ops;
+
+    printf("%-16s n=%-7d add %10.1f ns  adjust %10.1f ns  del %8.1f ns\n", name, n, add_ns, adjust_ns, del_ns);
+    delete lst;
+}
+
+// 按tick_ms的间隔驱动时间轮(与reactor的timerfd相同)，超时时间随机分布在槽内的任意位置，
+// 包括当前槽中还没到期的和已经过期的；统计每个定时器触发时比超时时间晚了多少
+static bool check_accuracy(int tick_ms, int n, int span_ms) {
+    time_wheel wheel;
+    wheel.init(tick_ms);
+    std::vector<client_timer> users(n);
+    fired_base = users.data();
+    fired_ms.assign(n, -1);
+    srand(2);
+    time_t base = time_wheel::now_ms();
+    for (int i = 0; i < n; ++i) {
+        util_timer* timer = &users[i].timer;
+        timer->cb_func = record_func;
+        timer->user_data = &users[i];
+        timer->expire = base + rand() % span_ms - tick_ms;
+        wheel.add_timer(timer);
+    }
+    // COARSE时钟的精度和sleep的误差
+    struct timespec res;
+    clock_getres(CLOCK_MONOTONIC_COARSE, &res);
+    time_t slack = res.tv_nsec / 1000000 + 5;
+    struct timespec interval = {tick_ms / 1000, (tick_ms % 1000) * 1000000L};
+    while (time_wheel::now_ms() < base + span_ms + 2 * tick_ms) {
+        nanosleep(&interval, NULL);
+        wheel.tick();
+    }
+    int missed = 0, late = 0;
+    time_t worst = 0;
+    for (int i = 0; i < n; ++i) {
+        time_t expire = users[i].timer.expire;
+        if (fired_ms[i] < 0) {
+            missed++;
+            wheel.del_timer(&users[i].timer);
+            continue;
+        }
+        // 已经过期的定时器从加入时算起
+        time_t delay = fired_ms[i] - (expire > base ? expire : base);
+        if (delay > worst) {
+            worst = delay;
+        }
+        if (delay > tick_ms + slack) {
+            late++;
+        }
+    }
+    printf("time_wheel tick=%dms n=%d: max delay %ld ms, late %d, missed %d\n", tick_ms, n, (long)worst, late, missed);
+    return missed == 0 && late == 0;
+}
+
+int main() {
+    bool ok = check_accuracy(100, 1000, 1500) && check_accuracy(20, 1000, 500);
+    int sizes[] = {1000, 10000, 100000};
+    for (int i = 0; i < 3; ++i) {
+        int n = sizes[i];
+        int ops = n < 10000 ? n : 10000;
+        bench<sort_timer_lst>("sort_timer_lst", n, ops);
+        bench<time_wheel>("time_wheel", n, ops);
+    }
+    return ok ? 0 : 1;
+}
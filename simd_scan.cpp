@@ -0,0 +1,150 @@
+#include "simd_scan.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+typedef const char* (*scan_fn)(const char*, const char*);
+
+// 逐字节查找，也用于处理向量实现剩下的不足一个向量的尾部
+static const char* eol_scalar(const char* p, const char* end) {
+    while (p < end && *p != '\r' && *p != '\n') {
+        ++p;
+    }
+    return p;
+}
+
+static const char* blank_scalar(const char* p, const char* end) {
+    while (p < end && *p != ' ' && *p != '\t') {
+        ++p;
+    }
+    return p;
+}
+
+#ifdef SCAN_X86
+// SSE4.2：pcmpestri的EQUAL_ANY模式一条指令即可在16个字节中找到集合内任一字符的第一个位置
+#define SCAN_SSE42_MODE (_SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT)
+
+__attribute__((target("sse4.2"))) static const char* scan2_sse42(const char* p, const char* end, char a, char b) {
+    const __m128i set = _mm_setr_epi8(a, b, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        int idx = _mm_cmpestri(set, 2, v, 16, SCAN_SSE42_MODE);
+        if (idx != 16) {
+            return p + idx;
+        }
+        p += 16;
+    }
+    return p;
+}
+
+// AVX2：分别与两个字符逐字节比较，合并后的掩码中最低的置位即第一个匹配
+__attribute__((target("avx2"))) static const char* scan2_avx2(const char* p, const char* end, char a, char b) {
+    const __m256i va = _mm256_set1_epi8(a);
+    const __m256i vb = _mm256_set1_epi8(b);
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        __m256i hit = _mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(hit);
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+    return p;
+}
+
+static const char* eol_sse42(const char* p, const char* end) {
+    p = scan2_sse42(p, end, '\r', '\n');
+    return eol_scalar(p, end);
+}
+
+static const char* blank_sse42(const char* p, const char* end) {
+    p = scan2_sse42(p, end, ' ', '\t');
+    return blank_scalar(p, end);
+}
+
+static const char* eol_avx2(const char* p, const char* end) {
+    p = scan2_avx2(p, end, '\r', '\n');
+    return eol_scalar(p, end);
+}
+
+static const char* blank_avx2(const char* p, const char* end) {
+    p = scan2_avx2(p, end, ' ', '\t');
+    return blank_scalar(p, end);
+}
+#endif
+
+static bool level_supported(int level) {
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (level == SCAN_AVX2) {
+        return __builtin_cpu_supports("avx2");
+    }
+    if (level == SCAN_SSE42) {
+        return __builtin_cpu_supports("sse4.2");
+    }
+#endif
+    return level == SCAN_SCALAR;
+}
+
+static int best_level() {
+    if (level_supported(SCAN_AVX2)) {
+        return SCAN_AVX2;
+    }
+    if (level_supported(SCAN_SSE42)) {
+        return SCAN_SSE42;
+    }
+    return SCAN_SCALAR;
+}
+
+// 启动时选定，之后只读
+static int current_level = SCAN_SCALAR;
+static scan_fn eol_impl = eol_scalar;
+static scan_fn blank_impl = blank_scalar;
+
+bool scan_select(int level) {
+    if (!level_supported(level)) {
+        return false;
+    }
+    current_level = level;
+    switch (level) {
+#ifdef SCAN_X86
+        case SCAN_AVX2:
+            eol_impl = eol_avx2;
+            blank_impl = blank_avx2;
+            break;
+        case SCAN_SSE42:
+            eol_impl = eol_sse42;
+            blank_impl = blank_sse42;
+            break;
+#endif
+        default:
+            eol_impl = eol_scalar;
+            blank_impl = blank_scalar;
+            break;
+    }
+    return true;
+}
+
+// 在main之前选择CPU支持的最快实现
+__attribute__((constructor)) static void scan_init() {
+    scan_select(best_level());
+}
+
+const char* scan_eol(const char* p, const char* end) {
+    return eol_impl(p, end);
+}
+
+const char* scan_blank(const char* p, const char* end) {
+    return blank_impl(p, end);
+}
+
+int scan_level() {
+    return current_level;
+}
+
+const char* scan_level_name(int level) {
+    static const char* names[] = {"scalar", "sse4.2", "avx2"};
+    return names[level];
+}
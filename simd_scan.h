@@ -0,0 +1,20 @@
+#ifndef SIMD_SCAN_H
+#define SIMD_SCAN_H
+
+// 请求解析用的字节扫描
+// 每次比较16(SSE4.2)或32(AVX2)个字节，启动时按CPU支持的指令集选择实现，都不支持时逐字节查找
+
+enum SCAN_LEVEL { SCAN_SCALAR = 0, SCAN_SSE42, SCAN_AVX2 };
+
+// 返回[p, end)中第一个\r或\n的位置，没有则返回end
+const char* scan_eol(const char* p, const char* end);
+// 返回[p, end)中第一个空格或\t的位置，没有则返回end
+const char* scan_blank(const char* p, const char* end);
+
+// 当前使用的实现
+int scan_level();
+const char* scan_level_name(int level);
+// 切换实现(基准测试用)，CPU不支持时返回false
+bool scan_select(int level);
+
+#endif
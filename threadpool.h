@@ -2,27 +2,107 @@
 #define THREADPOOL_H
 
 #include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
 #include <cstdio>
 #include <exception>
-#include <list>
+#include "affinity.h"
 #include "locker.h"
-#include "sql_connection_pool.h"
+#include "mpmc_queue.h"
 
 // 线程池类
+// 每个工作线程有自己的请求队列，绑定在固定的CPU上；
+// append按调用者所在的CPU把请求放进同核(其次同NUMA节点)工作线程的队列，
+// 工作线程先取自己的队列，为空时从其他工作线程的队列中窃取，
+// 因此某个工作线程卡在慢查询上时，它队列中的请求仍会被其他线程处理
+// 线程池不再为每个请求预取数据库连接，需要访问数据库的请求自行从连接池租用
+
+#define WAIT_BUCKETS 24  // 排队时间直方图的桶数，第i个桶为[2^(i-1), 2^i)微秒
+
+// 线程池的运行统计，各工作线程的计数之和
+struct threadpool_stats {
+    unsigned long local_hits;     // 从自己队列取到的请求数
+    unsigned long steals;         // 从其他队列窃取到的请求数
+    unsigned long wait_total_us;  // 累计排队时间(微秒)
+    unsigned long wait_max_us;    // 最长排队时间(微秒)
+    unsigned long wait_hist[WAIT_BUCKETS];
+    int pending;                  // 当前在队列中等待的请求数
+
+    unsigned long completed() const { return local_hits + steals; }
+    // 排队时间的p分位数(0<p<=1)，返回所在桶的上界，落在最后一个桶时返回最长排队时间
+    unsigned long wait_percentile(double p) const {
+        unsigned long n = completed();
+        if (n == 0) {
+            return 0;
+        }
+        unsigned long target = (unsigned long)(n * p + 0.999999);
+        unsigned long sum = 0;
+        for (int i = 0; i < WAIT_BUCKETS - 1; ++i) {
+            sum += wait_hist[i];
+            if (sum >= target) {
+                return 1UL << i;
+            }
+        }
+        return wait_max_us;
+    }
+};
+
 template <typename T>
 class threadpool {
    public:
-    // connPool: 数据库连接池
     // thread_number：线程池中线程数量，
-    // max_requests：请求队列中最多允许的、等待处理的请求的数量
-    threadpool(connection_pool* connPool, int thread_number = 8, int max_requests = 10000);
+    // max_requests：请求队列中最多允许的、等待处理的请求的数量(所有工作线程队列之和)
+    // first_cpu：第i个工作线程绑定到cpu_for(first_cpu + i)，不同线程池从不同的序号开始
+    threadpool(int thread_number = 8, int max_requests = 10000, int first_cpu = 0);
     ~threadpool();
-    bool append(T* request);
+    // cpu：调用者所在的CPU，为-1时由sched_getcpu获取
+    bool append(T* request, int cpu = -1);
+    // 当前在队列中等待的请求数
+    int pending() const { return m_pending.load(std::memory_order_relaxed); }
+    // 队列中等待最久的请求已经等了多久(微秒)，所有队列都为空时为0，用来判断是否过载
+    // 工作线程全部卡住、没有请求被取出时也会随时间增长
+    unsigned long oldest_wait_us() const;
+    // 汇总各工作线程的统计
+    void stats(threadpool_stats* st);
 
    private:
+    // 队列中的元素，记录入队时间用于统计排队时间
+    struct task {
+        T* request;
+        unsigned long enqueue_us;
+    };
+
+    // 每个工作线程的队列、休眠用的事件计数和统计，按缓存行对齐避免伪共享
+    // 统计只由所属的工作线程写入，读取时允许看到稍旧的值
+    struct alignas(CACHELINE_SIZE) worker_slot {
+        threadpool* pool;
+        int index;
+        int cpu;
+        int node;
+        mpmc_queue<task>* queue;
+        eventcount queuestat;
+        std::atomic<unsigned long> local_hits;  // 从自己队列取到的请求数
+        std::atomic<unsigned long> steals;      // 从其他队列窃取到的请求数
+        std::atomic<unsigned long> wait_total_us;
+        std::atomic<unsigned long> wait_max_us;
+        std::atomic<unsigned long> wait_hist[WAIT_BUCKETS];
+    };
+
     // 工作线程运行的函数，不断从请求队列中取出任务并执行
     static void* worker(void* arg);
-    void run();
+    void run(worker_slot* self);
+    // 为cpu上的调用者挑选一个工作线程
+    int home_worker(int cpu);
+    // 从self以外的队列中窃取一个请求
+    bool steal(worker_slot* self, task& t);
+    // 记录一个请求的排队时间
+    static void account_wait(worker_slot* self, const task& t);
+    static unsigned long now_us() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+    }
 
    private:
     // 线程数
@@ -34,31 +114,30 @@ class threadpool {
     // 请求队列中最多允许的、等待处理的请求的数量
     int m_max_requests;
 
-    // 请求队列，双向链表
-    std::list<T*> m_workqueue;
+    // 所有队列中等待处理的请求总数
+    std::atomic<int> m_pending;
 
-    // 请求队列的互斥锁
-    locker m_queuelocker;
+    // 工作线程
+    worker_slot* m_slots;
 
-    // 信号量表示是否有任务需要处理
-    sem m_queuestat;
+    // 轮询计数，同核没有工作线程时在同节点的工作线程间轮流分配
+    std::atomic<unsigned int> m_next;
 
     // 是否结束线程
-    bool m_stop;
-
-    // 数据库
-    connection_pool* m_connPool;
+    std::atomic<bool> m_stop;
 };
 
 // 构造函数
 template <typename T>
-threadpool<T>::threadpool(connection_pool* connPool, int thread_number, int max_requests)
+threadpool<T>::threadpool(int thread_number, int max_requests, int first_cpu)
     : m_thread_number(thread_number),
-      m_max_requests(max_requests),
-      m_stop(false),
       m_threads(NULL),
-      m_connPool(connPool) {
-    
+      m_max_requests(max_requests),
+      m_pending(0),
+      m_slots(NULL),
+      m_next(0),
+      m_stop(false) {
+
     if ((thread_number <= 0) || (max_requests <= 0)) {
         throw std::exception();
     }
@@ -68,10 +147,27 @@ threadpool<T>::threadpool(connection_pool* connPool, int thread_number, int max_
         throw std::exception();
     }
 
+    // 每个队列的容量都是max_requests，总数由m_pending限制，所以单个队列积压时不会提前失败
+    m_slots = new worker_slot[m_thread_number];
+    for (int i = 0; i < thread_number; ++i) {
+        m_slots[i].pool = this;
+        m_slots[i].index = i;
+        m_slots[i].cpu = cpu_for(first_cpu + i);
+        m_slots[i].node = cpu_node(m_slots[i].cpu);
+        m_slots[i].queue = new mpmc_queue<task>(max_requests);
+        m_slots[i].local_hits = 0;
+        m_slots[i].steals = 0;
+        m_slots[i].wait_total_us = 0;
+        m_slots[i].wait_max_us = 0;
+        for (int j = 0; j < WAIT_BUCKETS; ++j) {
+            m_slots[i].wait_hist[j] = 0;
+        }
+    }
+
     // 创建thread_number个线程
     for (int i = 0; i < thread_number; ++i) {
         // printf("create the %dth thread\n", i);
-        if (pthread_create(m_threads + i, NULL, worker, this) != 0) {
+        if (pthread_create(m_threads + i, NULL, worker, m_slots + i) != 0) {
             delete[] m_threads;
             throw std::exception();
         }
@@ -88,51 +184,178 @@ template <typename T>
 threadpool<T>::~threadpool() {
     delete[] m_threads;
     m_stop = true;
+    // 唤醒所有休眠的工作线程，使其退出
+    for (int i = 0; i < m_thread_number; ++i) {
+        m_slots[i].queuestat.notify_all();
+    }
+}
+
+// 同核的工作线程优先，其次同NUMA节点，都没有时按CPU号取模
+template <typename T>
+int threadpool<T>::home_worker(int cpu) {
+    for (int i = 0; i < m_thread_number; ++i) {
+        if (m_slots[i].cpu == cpu) {
+            return i;
+        }
+    }
+    int node = cpu_node(cpu);
+    unsigned int start = m_next.fetch_add(1, std::memory_order_relaxed);
+    for (int i = 0; i < m_thread_number; ++i) {
+        int idx = (start + i) % m_thread_number;
+        if (m_slots[idx].node == node) {
+            return idx;
+        }
+    }
+    return cpu % m_thread_number;
 }
 
 // 向请求队列增加一个任务
 template <typename T>
-bool threadpool<T>::append(T* request) {
-    // 操作工作队列时一定要加锁，因为它被所有线程共享。
-    m_queuelocker.lock();
-    if (m_workqueue.size() > m_max_requests) {
-        m_queuelocker.unlock();
+bool threadpool<T>::append(T* request, int cpu) {
+    // 所有队列中已有m_max_requests个请求时失败
+    if (m_pending.fetch_add(1, std::memory_order_relaxed) >= m_max_requests) {
+        m_pending.fetch_sub(1, std::memory_order_relaxed);
         return false;
     }
-    m_workqueue.push_back(request);
-    m_queuelocker.unlock();
-    m_queuestat.post();
+    if (cpu < 0) {
+        cpu = sched_getcpu();
+    }
+    worker_slot* home = &m_slots[home_worker(cpu)];
+    task t;
+    t.request = request;
+    t.enqueue_us = now_us();
+    if (!home->queue->push(t, t.enqueue_us)) {
+        m_pending.fetch_sub(1, std::memory_order_relaxed);
+        return false;
+    }
+    // 本地工作线程在休眠则唤醒它；它正忙时唤醒一个休眠的其他工作线程来窃取
+    if (home->queuestat.waiting()) {
+        home->queuestat.notify();
+        return true;
+    }
+    for (int i = 1; i < m_thread_number; ++i) {
+        worker_slot* peer = &m_slots[(home->index + i) % m_thread_number];
+        if (peer->queuestat.waiting()) {
+            peer->queuestat.notify();
+            break;
+        }
+    }
     return true;
 }
 
+// 从其他工作线程的队列中窃取，从下一个线程开始依次尝试
+template <typename T>
+bool threadpool<T>::steal(worker_slot* self, task& t) {
+    for (int i = 1; i < m_thread_number; ++i) {
+        worker_slot* victim = &m_slots[(self->index + i) % m_thread_number];
+        if (victim->queue->pop(t)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename T>
+void threadpool<T>::account_wait(worker_slot* self, const task& t) {
+    unsigned long wait = now_us() - t.enqueue_us;
+    int bucket = 0;
+    while (bucket < WAIT_BUCKETS - 1 && (1UL << bucket) <= wait) {
+        ++bucket;
+    }
+    // 只有本线程写入，不需要原子的读-改-写
+    self->wait_hist[bucket].store(self->wait_hist[bucket].load(std::memory_order_relaxed) + 1,
+                                  std::memory_order_relaxed);
+    self->wait_total_us.store(self->wait_total_us.load(std::memory_order_relaxed) + wait,
+                              std::memory_order_relaxed);
+    if (wait > self->wait_max_us.load(std::memory_order_relaxed)) {
+        self->wait_max_us.store(wait, std::memory_order_relaxed);
+    }
+}
+
+// 每个队列都是先进先出，队头就是该队列中最早入队的请求
+template <typename T>
+unsigned long threadpool<T>::oldest_wait_us() const {
+    unsigned long oldest = 0;
+    bool found = false;
+    for (int i = 0; i < m_thread_number; ++i) {
+        unsigned long stamp;
+        if (m_slots[i].queue->head_stamp(&stamp) && (!found || stamp < oldest)) {
+            oldest = stamp;
+            found = true;
+        }
+    }
+    if (!found) {
+        return 0;
+    }
+    unsigned long now = now_us();
+    return now > oldest ? now - oldest : 0;
+}
+
+template <typename T>
+void threadpool<T>::stats(threadpool_stats* st) {
+    memset(st, 0, sizeof(*st));
+    for (int i = 0; i < m_thread_number; ++i) {
+        worker_slot* s = &m_slots[i];
+        st->local_hits += s->local_hits.load(std::memory_order_relaxed);
+        st->steals += s->steals.load(std::memory_order_relaxed);
+        st->wait_total_us += s->wait_total_us.load(std::memory_order_relaxed);
+        unsigned long max = s->wait_max_us.load(std::memory_order_relaxed);
+        if (max > st->wait_max_us) {
+            st->wait_max_us = max;
+        }
+        for (int j = 0; j < WAIT_BUCKETS; ++j) {
+            st->wait_hist[j] += s->wait_hist[j].load(std::memory_order_relaxed);
+        }
+    }
+    st->pending = pending();
+}
+
 // 工作线程函数
 template <typename T>
 void* threadpool<T>::worker(void* arg) {
-    // 将参数强转为线程池类(当前线程池)，调用成员方法
-    threadpool* pool = (threadpool*)arg;
-    pool->run();
+    // 参数为该线程的worker_slot，通过它找到所属线程池(当前线程池)，调用成员方法
+    worker_slot* self = (worker_slot*)arg;
+    threadpool* pool = self->pool;
+    pin_thread(self->cpu);
+    pool->run(self);
     return pool;
 }
 
-// 从请求队列取出任务并执行
+// 先取自己队列中的任务，没有则窃取，都没有时休眠
 template <typename T>
-void threadpool<T>::run() {
+void threadpool<T>::run(worker_slot* self) {
     while (!m_stop) {
-        m_queuestat.wait();
-        m_queuelocker.lock();
-        if (m_workqueue.empty()) {
-            m_queuelocker.unlock();
-            continue;
+        task t;
+        bool got = false;
+        if (self->queue->pop(t)) {
+            self->local_hits.fetch_add(1, std::memory_order_relaxed);
+            got = true;
+        } else if (steal(self, t)) {
+            self->steals.fetch_add(1, std::memory_order_relaxed);
+            got = true;
+        } else {
+            // 先登记为等待者再检查一次，避免与append之间丢失唤醒
+            uint32_t key = self->queuestat.prepare_wait();
+            if (self->queue->pop(t)) {
+                self->local_hits.fetch_add(1, std::memory_order_relaxed);
+                got = true;
+            } else if (steal(self, t)) {
+                self->steals.fetch_add(1, std::memory_order_relaxed);
+                got = true;
+            }
+            if (got || m_stop) {
+                self->queuestat.cancel_wait();
+            } else {
+                self->queuestat.wait(key);
+                continue;
+            }
         }
-        T* request = m_workqueue.front();
-        m_workqueue.pop_front();
-        m_queuelocker.unlock();
-        if (!request) {
+        if (!got) {
             continue;
         }
-
-        connectionRAII mysqlcon(&request->mysql, m_connPool);
-        request->process();
+        m_pending.fetch_sub(1, std::memory_order_relaxed);
+        account_wait(self, t);
+        t.request->process();
     }
 }
 
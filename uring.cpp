@@ -0,0 +1,258 @@
+#include "uring.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// 提供缓冲区所属的组号
+static const int URING_BUF_GROUP = 0;
+
+static int io_uring_setup(unsigned int entries, struct io_uring_params* p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+uring_reactor::uring_reactor()
+    : m_ring_fd(-1),
+      m_sqes(NULL),
+      m_sq_ptr(MAP_FAILED),
+      m_cq_ptr(MAP_FAILED),
+      m_bufs(NULL),
+      m_eventfd(-1) {}
+
+uring_reactor::~uring_reactor() {
+    if (m_sqes) {
+        munmap(m_sqes, m_sqes_len);
+    }
+    if (m_cq_ptr != MAP_FAILED && m_cq_ptr != m_sq_ptr) {
+        munmap(m_cq_ptr, m_cq_len);
+    }
+    if (m_sq_ptr != MAP_FAILED) {
+        munmap(m_sq_ptr, m_sq_len);
+    }
+    if (m_ring_fd != -1) {
+        close(m_ring_fd);
+    }
+    if (m_eventfd != -1) {
+        close(m_eventfd);
+    }
+    free(m_bufs);
+}
+
+bool uring_reactor::init(unsigned int entries, int buf_num, int buf_size) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    m_ring_fd = io_uring_setup(entries, &p);
+    if (m_ring_fd < 0) {
+        return false;
+    }
+    // 多次触发的accept和提供缓冲区都需要较新的内核
+    if (!(p.features & IORING_FEAT_FAST_POLL)) {
+        return false;
+    }
+
+    // 映射提交队列和完成队列，新内核两者共用一次mmap
+    m_sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    m_cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (m_cq_len > m_sq_len) {
+            m_sq_len = m_cq_len;
+        }
+        m_cq_len = m_sq_len;
+    }
+    m_sq_ptr = mmap(0, m_sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQ_RING);
+    if (m_sq_ptr == MAP_FAILED) {
+        return false;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        m_cq_ptr = m_sq_ptr;
+    } else {
+        m_cq_ptr = mmap(0, m_cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_CQ_RING);
+        if (m_cq_ptr == MAP_FAILED) {
+            return false;
+        }
+    }
+    m_sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(0, m_sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        return false;
+    }
+    m_sqes = (struct io_uring_sqe*)sqes;
+
+    char* sq = (char*)m_sq_ptr;
+    m_sq_head = (unsigned int*)(sq + p.sq_off.head);
+    m_sq_tail = (unsigned int*)(sq + p.sq_off.tail);
+    m_sq_mask = (unsigned int*)(sq + p.sq_off.ring_mask);
+    m_sq_array = (unsigned int*)(sq + p.sq_off.array);
+    m_sq_entries = p.sq_entries;
+    m_sqe_tail = *m_sq_tail;
+    // sqe与array一一对应，提交时只需移动尾指针
+    for (unsigned int i = 0; i < m_sq_entries; ++i) {
+        m_sq_array[i] = i;
+    }
+
+    char* cq = (char*)m_cq_ptr;
+    m_cq_head = (unsigned int*)(cq + p.cq_off.head);
+    m_cq_tail = (unsigned int*)(cq + p.cq_off.tail);
+    m_cq_mask = (unsigned int*)(cq + p.cq_off.ring_mask);
+    m_cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+
+    // 接收缓冲区一次性全部提供给内核
+    m_buf_num = buf_num;
+    m_buf_size = buf_size;
+    m_bufs = (char*)malloc((size_t)buf_num * buf_size);
+    if (!m_bufs) {
+        return false;
+    }
+    struct io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = buf_num;
+    sqe->addr = (unsigned long)m_bufs;
+    sqe->len = buf_size;
+    sqe->off = 0;
+    sqe->buf_group = URING_BUF_GROUP;
+    sqe->user_data = ur_pack(UR_PROVIDE, 0, 0);
+
+    m_eventfd = eventfd(0, EFD_CLOEXEC);
+    if (m_eventfd < 0) {
+        return false;
+    }
+    return true;
+}
+
+// 取一个空闲的sqe，提交队列已满则先提交
+struct io_uring_sqe* uring_reactor::get_sqe() {
+    unsigned int head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+    if (m_sqe_tail - head >= m_sq_entries) {
+        submit(0);
+        head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+    }
+    struct io_uring_sqe* sqe = &m_sqes[m_sqe_tail & *m_sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    m_sqe_tail++;
+    return sqe;
+}
+
+int uring_reactor::submit(unsigned int wait_nr) {
+    unsigned int tail = *m_sq_tail;
+    unsigned int to_submit = m_sqe_tail - tail;
+    // 发布新的尾指针，内核据此看到填充好的sqe
+    __atomic_store_n(m_sq_tail, m_sqe_tail, __ATOMIC_RELEASE);
+    int ret;
+    do {
+        ret = io_uring_enter(m_ring_fd, to_submit, wait_nr, wait_nr ? IORING_ENTER_GETEVENTS : 0);
+    } while (ret < 0 && errno == EINTR && wait_nr == 0);
+    return ret;
+}
+
+int uring_reactor::submit_and_wait() {
+    // 已经有完成事件时不阻塞
+    if (__atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE) != *m_cq_head) {
+        return submit(0);
+    }
+    return submit(1);
+}
+
+struct io_uring_cqe* uring_reactor::peek_cqe() {
+    unsigned int head = *m_cq_head;
+    if (head == __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    return &m_cqes[head & *m_cq_mask];
+}
+
+void uring_reactor::cqe_seen() {
+    __atomic_store_n(m_cq_head, *m_cq_head + 1, __ATOMIC_RELEASE);
+}
+
+void uring_reactor::prep_accept(int listenfd) {
+    struct io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listenfd;
+    // 一次提交，每个新连接都产生一个完成事件
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = ur_pack(UR_ACCEPT, listenfd, 0);
+}
+
+// 被取消的accept以-ECANCELED完成且不带IORING_CQE_F_MORE
+void uring_reactor::prep_cancel_accept(int listenfd) {
+    struct io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = ur_pack(UR_ACCEPT, listenfd, 0);
+    sqe->user_data = ur_pack(UR_CANCEL, listenfd, 0);
+}
+
+void uring_reactor::prep_recv(int fd, unsigned int gen) {
+    struct io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->len = m_buf_size;
+    // 由内核从提供缓冲区组中挑选一个接收缓冲区，空闲连接不占用缓冲区
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUF_GROUP;
+    sqe->user_data = ur_pack(UR_RECV, fd, gen);
+}
+
+void uring_reactor::prep_writev(int fd, unsigned int gen, struct iovec* iov, int count) {
+    struct io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long)iov;
+    sqe->len = count;
+    sqe->user_data = ur_pack(UR_SEND, fd, gen);
+}
+
+void uring_reactor::prep_provide(int bid) {
+    struct io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = 1;
+    sqe->addr = (unsigned long)buffer(bid);
+    sqe->len = m_buf_size;
+    sqe->off = bid;
+    sqe->buf_group = URING_BUF_GROUP;
+    sqe->user_data = ur_pack(UR_PROVIDE, 0, 0);
+}
+
+void uring_reactor::prep_read(int op, int fd, void* buf, unsigned int len) {
+    struct io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long)buf;
+    sqe->len = len;
+    sqe->user_data = ur_pack(op, fd, 0);
+}
+
+void uring_reactor::prep_wakeup() {
+    struct io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = m_eventfd;
+    sqe->addr = (unsigned long)&m_eventfd_val;
+    sqe->len = sizeof(m_eventfd_val);
+    sqe->user_data = ur_pack(UR_WAKEUP, m_eventfd, 0);
+}
+
+void uring_reactor::post(int fd, unsigned int gen, int ev) {
+    uring_post p = {fd, gen, ev};
+    m_postlocker.lock();
+    bool wake = m_posted.empty();
+    m_posted.push_back(p);
+    m_postlocker.unlock();
+    // 队列由空变非空时才需要唤醒reactor线程
+    if (wake) {
+        uint64_t one = 1;
+        ::write(m_eventfd, &one, sizeof(one));
+    }
+}
+
+void uring_reactor::take_posted(std::vector<uring_post>& out) {
+    m_postlocker.lock();
+    out.swap(m_posted);
+    m_postlocker.unlock();
+}
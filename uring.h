@@ -0,0 +1,102 @@
+#ifndef URING_H
+#define URING_H
+
+#include <linux/io_uring.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#include <vector>
+#include "locker.h"
+
+// io_uring后端，直接使用系统调用，不依赖liburing
+// 每个reactor线程拥有一个uring_reactor：一个提交/完成队列、一组提供给内核的接收缓冲区，
+// 以及一个eventfd，工作线程通过它通知reactor线程为某个连接提交recv或writev
+
+// user_data的编码：高32位为连接的代数，用于丢弃已关闭连接的迟到完成事件，中间为fd，低8位为操作类型
+enum URING_OP { UR_ACCEPT = 1, UR_RECV, UR_SEND, UR_PROVIDE, UR_TIMER, UR_SIGNAL, UR_WAKEUP, UR_CANCEL };
+
+inline uint64_t ur_pack(int op, int fd, unsigned int gen) {
+    return ((uint64_t)gen << 32) | ((uint64_t)(unsigned int)fd << 8) | (uint64_t)op;
+}
+inline int ur_op(uint64_t data) { return (int)(data & 0xff); }
+inline int ur_fd(uint64_t data) { return (int)((data >> 8) & 0xffffff); }
+inline unsigned int ur_gen(uint64_t data) { return (unsigned int)(data >> 32); }
+
+// 工作线程请求的提交：gen为请求时连接的代数，reactor线程处理时连接已关闭或fd已被新连接复用则丢弃
+struct uring_post {
+    int fd;
+    unsigned int gen;
+    int ev;
+};
+
+class uring_reactor {
+   public:
+    uring_reactor();
+    ~uring_reactor();
+
+    // entries: 提交队列长度；buf_num/buf_size: 提供给内核的接收缓冲区个数和大小
+    bool init(unsigned int entries, int buf_num, int buf_size);
+
+    // 工作线程调用，请求reactor线程为代数为gen的连接fd提交读(EPOLLIN)或写(EPOLLOUT)
+    void post(int fd, unsigned int gen, int ev);
+    // reactor线程调用，取出工作线程的请求
+    void take_posted(std::vector<uring_post>& out);
+
+    // 以下均由reactor线程调用
+    void prep_accept(int listenfd);                                     // 多次触发的accept
+    void prep_cancel_accept(int listenfd);                              // 取消多次触发的accept
+    void prep_recv(int fd, unsigned int gen);                           // 由内核挑选接收缓冲区的recv
+    void prep_writev(int fd, unsigned int gen, struct iovec* iov, int count);
+    void prep_provide(int bid);                                         // 归还一个接收缓冲区
+    void prep_read(int op, int fd, void* buf, unsigned int len);        // 读取timerfd/signalfd
+    void prep_wakeup();                                                 // 读取eventfd
+
+    // 提交所有请求并至少等待一个完成事件
+    int submit_and_wait();
+    // 取出下一个完成事件，没有则返回NULL
+    struct io_uring_cqe* peek_cqe();
+    // 完成事件处理完毕
+    void cqe_seen();
+
+    char* buffer(int bid) { return m_bufs + (size_t)bid * m_buf_size; }
+
+   private:
+    struct io_uring_sqe* get_sqe();
+    int submit(unsigned int wait_nr);
+
+   private:
+    int m_ring_fd;
+    unsigned int m_sq_entries;
+
+    // 提交队列
+    unsigned int* m_sq_head;
+    unsigned int* m_sq_tail;
+    unsigned int* m_sq_mask;
+    unsigned int* m_sq_array;
+    struct io_uring_sqe* m_sqes;
+    unsigned int m_sqe_tail;  // 已填充但未提交的尾部
+
+    // 完成队列
+    unsigned int* m_cq_head;
+    unsigned int* m_cq_tail;
+    unsigned int* m_cq_mask;
+    struct io_uring_cqe* m_cqes;
+
+    void* m_sq_ptr;
+    size_t m_sq_len;
+    void* m_cq_ptr;
+    size_t m_cq_len;
+    size_t m_sqes_len;
+
+    // 提供给内核的接收缓冲区
+    char* m_bufs;
+    int m_buf_num;
+    int m_buf_size;
+
+    // 工作线程 -> reactor线程的请求队列
+    int m_eventfd;
+    uint64_t m_eventfd_val;
+    locker m_postlocker;
+    std::vector<uring_post> m_posted;
+};
+
+#endif